@@ -0,0 +1,46 @@
+#!/bin/sh
+# print a generated jlang program of about <statements> statements (an if or a loop
+# with its body counts as 4) to stdout: assignments, if/else and loops over 8 variables, so
+# that most blocks need phis. The same seed gives the same program.
+# usage: bench/genprog.sh <statements> [seed] > file.jlang
+
+if [ $# -lt 1 ]; then
+	echo "usage: $0 <statements> [seed]" >&2
+	exit 1
+fi
+
+awk -v n="$1" -v seed="${2:-1}" 'BEGIN {
+	srand(seed)
+	split("a b c d e f g h", vars, " ")
+
+	print "{"
+	for (i = 1; i <= 8; i++)
+		printf "\t%s = %d;\n", vars[i], int(rand() * 10)
+
+	count = 8
+	while (count < n) {
+		a = vars[int(rand() * 8) + 1]
+		b = vars[int(rand() * 8) + 1]
+		c = vars[int(rand() * 8) + 1]
+		r = rand()
+		if (r < 0.5) {
+			printf "\t%s = %s + %s * 3 - 1;\n", a, b, c
+			count += 1
+		}
+		else if (r < 0.75) {
+			printf "\tif (%s < %s) {\n\t\t%s = %s + 1;\n\t\t%s = %s - 2;\n\t}\n", b, c, a, b, c, a
+			printf "\telse {\n\t\t%s = %s - %s;\n\t}\n", a, c, b
+			count += 4
+		}
+		else {
+			printf "\tfor (i = 0; i < 3; i = i + 1) {\n\t\t%s = %s + i;\n", a, a
+			printf "\t\tif (%s > 1000) {\n\t\t\t%s = 0;\n\t\t}\n\t}\n", a, a
+			count += 4
+		}
+	}
+
+	print "\tr = a + b + c + d + e + f + g + h;"
+	print "\tputchar(r - r / 10 * 10 + 48);"
+	print "\treturn 0;"
+	print "}"
+}'
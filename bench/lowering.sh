@@ -0,0 +1,20 @@
+#!/bin/sh
+# compare --lowering=ssa and --lowering=memory on the given programs
+# prints codegen time (ms, from --time-report), instructions and phis in the
+# generated bitcode, and instructions left after opt -O2
+# usage: bench/lowering.sh file.jlang...
+
+JLANG=${JLANG:-./jlang}
+
+printf "%-24s %-7s %10s %8s %6s %8s\n" file mode codegen_ms insts phis o2_insts
+for file in "$@"; do
+	bc="${file%.*}.bc"
+	for mode in ssa memory; do
+		ms=$($JLANG --lowering=$mode --time-report "$file" 2>&1 >/dev/null |
+			awk '$NF == "codegen" { printf "%.1f", $1 * 1000; exit }')
+		insts=$(llvm-dis "$bc" -o - | grep -c '^  ')
+		phis=$(llvm-dis "$bc" -o - | grep -c ' = phi ')
+		o2=$(opt -O2 "$bc" -o - | llvm-dis | grep -c '^  ')
+		printf "%-24s %-7s %10s %8s %6s %8s\n" "$(basename "$file")" $mode "$ms" "$insts" "$phis" "$o2"
+	done
+done
@@ -2,6 +2,7 @@
 #define AST_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "lex.h"
 
 enum ast_node_type {
@@ -26,12 +27,26 @@ struct ast_node_list {
 	struct ast_node *l;
 	size_t size, capacity;
 };
+// set by passes that run between parse and codegen
+enum ast_node_flag {
+	// assignment whose value is never read, codegen only brings the variable into scope
+	AST_FLAG_DEAD_STORE = 1 << 0,
+	// statement list, if or for after which control never continues
+	// (it always ends in return/break/continue, or loops forever)
+	AST_FLAG_TERMINATES = 1 << 1,
+	// for loop whose body never reaches the step (no continue and the body terminates),
+	// it runs at most once
+	AST_FLAG_LOOP_ONCE = 1 << 2,
+	// for loop whose condition is known to be true on entry
+	AST_FLAG_LOOP_ENTERS = 1 << 3
+};
 union ast_node_value {
 	struct ast_node_list children;
 	struct lex_token token;
 };
 struct ast_node {
 	enum ast_node_type type;
+	unsigned flags;
 
 	// terminals are lex_token, nonterminals are list of ast_node
 	// i.e. if type is AST_LEAF, then "value" is lex_token
@@ -51,6 +66,10 @@ size_t ast_insert_leaf(struct ast_node *node, const struct lex_token *token);
 
 bool ast_remove_node(struct ast_node *node, size_t index);
 
+struct ast_node ast_copy_node(const struct ast_node *node);
+bool ast_contains(const struct ast_node *node, enum ast_node_type type);
+bool ast_get_constant(const struct ast_node *node, int32_t *value);
+
 void ast_print(const struct ast_node *root);
 
 #endif
@@ -2,14 +2,14 @@
 #define CODEGEN_ASSIGNMENT_H
 
 #include <llvm-c/Core.h>
+#include "codegen/context.h"
 #include "utils/strmap.h"
 #include "ast.h"
 
 void codegen_assignment(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
-	struct strmap *var_map,
-	struct strmap *func_map
+	struct strmap *var_map
 );
 
 #endif
@@ -2,11 +2,56 @@
 #define CODEGEN_H
 
 #include <llvm-c/Core.h>
+#include <llvm-c/TargetMachine.h>
 #include <stdbool.h>
 #include "ast.h"
 
-LLVMModuleRef codegen_get_current_module(void);
-bool codegen(const char *name, const struct ast_node *root);
+// how variables are lowered, see codegen/ssa.h
+// auto is ssa, which is not slower than memory at any size bench/lowering.sh measures
+enum codegen_lowering {
+	CODEGEN_LOWERING_AUTO,
+	CODEGEN_LOWERING_SSA,
+	CODEGEN_LOWERING_MEMORY
+};
+
+// what i32 +, - and * do on overflow
+// wrap: two's complement, undefined: nsw flags (the optimizer may assume it does not
+// happen), trap: checked with llvm.s*.with.overflow, the program stops with llvm.trap
+enum codegen_overflow {
+	CODEGEN_OVERFLOW_WRAP,
+	CODEGEN_OVERFLOW_UNDEFINED,
+	CODEGEN_OVERFLOW_TRAP
+};
+
+// how a module is generated
+// discard_names: values and blocks get no names ("multmp", "ifelsephitmp", ...),
+// which saves allocating and uniquing them, the IR is only harder to read
+// verify: check the module with LLVMVerifyModule (an invalid module is a compiler bug)
+// debug_file: the source file for DWARF line tables (-g), NULL for no debug info
+struct codegen_options {
+	enum codegen_lowering lowering;
+	enum codegen_overflow overflow;
+	bool discard_names;
+	bool verify;
+	const char *debug_file;
+};
+
+void codegen_enable_time_passes(void);
+LLVMModuleRef codegen(const char *name, const struct ast_node *root, const struct codegen_options *options);
+// runs an optimization pipeline in the new pass manager syntax, e.g. "default<O2>"
+// or "instcombine,simplifycfg", returns false (after printing why) if it is invalid
+// machine is the one code is emitted for (codegen/emit.h), NULL when writing bitcode
+bool codegen_optimize(LLVMModuleRef mod, const char *pipeline, LLVMTargetMachineRef machine);
+
+// output path that means stdout
+#define CODEGEN_STDOUT "-"
+// these return false (after printing why) on failure
+bool codegen_write_bitcode(LLVMModuleRef mod, const char *path);
+// textual IR (.ll)
+bool codegen_write_ir(LLVMModuleRef mod, const char *path);
+bool codegen_write_stdout(const char *data, size_t size);
+
+void codegen_dispose(LLVMModuleRef mod);
 
 #endif
 
@@ -2,14 +2,19 @@
 #define CODEGEN_CONDITIONAL_H
 
 #include <llvm-c/Core.h>
+#include "codegen/context.h"
 #include "utils/strmap.h"
 #include "ast.h"
 
-void codegen_conditional(
-	LLVMBuilderRef build,
+// if/else whose branches are at most this many assignments (without calls or
+// divisions that could trap) are lowered to selects instead of branches
+#define CODEGEN_SELECT_MAX_ASSIGNS 4
+
+// returns true if control does not continue after the if
+bool codegen_conditional(
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
-	struct strmap *var_map,
-	struct strmap *func_map
+	struct strmap *var_map
 );
 
 #endif
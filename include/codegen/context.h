@@ -0,0 +1,47 @@
+#ifndef CODEGEN_CONTEXT_H
+#define CODEGEN_CONTEXT_H
+
+#include <llvm-c/Core.h>
+#include <llvm-c/DebugInfo.h>
+
+#include "codegen/codegen.h"
+#include "codegen/ssa.h"
+#include "utils/strmap.h"
+#include "ast.h"
+
+// innermost loop being generated, where continue/break go
+struct codegen_loop {
+	struct ssa_block *body_block;
+	struct ssa_block *cond_block;
+	struct ssa_block *after_block;
+
+	const struct ast_node *for_node;
+};
+
+// everything one module is generated with, passed to every codegen_* function
+// nothing is shared between contexts, and the allocators and statistics of utils/alloc.h
+// (and the STRMAP_STATS counters) are per thread, so modules can be generated on separate
+// threads. The parser keeps its state in globals though, so parse on one thread at a time
+struct codegen_ctx {
+	LLVMContextRef llvm_ctx;
+	LLVMModuleRef module;
+	LLVMBuilderRef build;
+	struct ssa_builder *ssa;
+
+	// declarations made in this module (name -> struct function_info)
+	struct strmap func_map;
+
+	// NULL outside of loops
+	const struct codegen_loop *loop;
+
+	enum codegen_overflow overflow;
+	// where failed overflow checks go, made on first use
+	struct ssa_block *trap_block;
+
+	// NULL without debug info, see codegen/debug.h
+	LLVMDIBuilderRef di_build;
+	// main's DISubprogram
+	LLVMMetadataRef di_scope;
+};
+
+#endif
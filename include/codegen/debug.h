@@ -0,0 +1,19 @@
+#ifndef CODEGEN_DEBUG_H
+#define CODEGEN_DEBUG_H
+
+#include <llvm-c/Core.h>
+#include "codegen/context.h"
+#include "ast.h"
+
+// DWARF line tables for -g: a compile unit for the source file and a subprogram for main,
+// instructions get the line of the statement (or loop part) they were generated for
+// all of these do nothing when the module is generated without debug info
+
+// path is the source file as given on the command line
+void codegen_debug_begin(struct codegen_ctx *ctx, LLVMValueRef main_func, const char *path, const struct ast_node *root);
+// instructions built from now on are attributed to the first line in node
+// nodes without tokens (continue, break) keep the current line
+void codegen_debug_location(struct codegen_ctx *ctx, const struct ast_node *node);
+void codegen_debug_finish(struct codegen_ctx *ctx);
+
+#endif
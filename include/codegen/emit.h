@@ -0,0 +1,44 @@
+#ifndef CODEGEN_EMIT_H
+#define CODEGEN_EMIT_H
+
+#include <llvm-c/Core.h>
+#include <llvm-c/TargetMachine.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// what machine code is generated for, NULL members are the defaults
+// triple: the host's (--target), cpu: the target's baseline (--mcpu, "native" is the host CPU with
+// all of its features), features: added to the CPU's, LLVM's "+avx2,-bmi" form (--mattr)
+struct emit_target {
+	const char *triple;
+	const char *cpu;
+	const char *features;
+};
+#define EMIT_CPU_NATIVE "native"
+
+// native code straight from the module in memory
+// opt_level is the -O level (0 to 3) for instruction selection and scheduling
+// returns NULL (after printing why) if LLVM was built without the target
+LLVMTargetMachineRef emit_create_target_machine(const struct emit_target *target, unsigned opt_level);
+void emit_dispose_target_machine(LLVMTargetMachineRef machine);
+
+// triple and data layout of the machine, set before optimizing so the passes know the target
+// functions defined in the module get the machine's CPU and features as target-cpu and
+// target-features attributes, so they survive in bitcode and are used by the JIT as well
+void emit_set_target(LLVMModuleRef mod, LLVMTargetMachineRef machine);
+
+// these return false (after printing why) on failure
+// type is LLVMAssemblyFile (.s) or LLVMObjectFile (.o), path can be CODEGEN_STDOUT
+// code generation changes the module (e.g. CodeGenPrepare), so bitcode and IR are written first
+bool emit_machine_code(
+	LLVMModuleRef mod,
+	LLVMTargetMachineRef machine,
+	LLVMCodeGenFileType type,
+	const char *path
+);
+// links the object files into an executable at path with the system compiler driver (cc)
+bool emit_link_executable(const char *const *objects, size_t num_objects, const char *path);
+// the same from a temporary object file
+bool emit_executable(LLVMModuleRef mod, LLVMTargetMachineRef machine, const char *path);
+
+#endif
@@ -2,41 +2,64 @@
 #define CODEGEN_EXPRESSION_H
 
 #include <llvm-c/Core.h>
+#include "codegen/context.h"
 #include "utils/strmap.h"
 #include "ast.h"
 #include "lex.h"
 
+// comparisons produce an i1, everything else an i32
+// an i1 is only widened when it is used as a number (stored, returned, passed, ...)
+enum codegen_value_kind {
+	CODEGEN_VALUE_INT,
+	CODEGEN_VALUE_BOOL
+};
+
+struct codegen_value {
+	LLVMValueRef value;
+	enum codegen_value_kind kind;
+};
+
 LLVMValueRef codegen_number(
 	LLVMContextRef llvm_ctx,
 	const struct lex_token *token
 );
 
 LLVMValueRef codegen_factor(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
-	const struct strmap *var_map,
-	struct strmap *func_map
+	const struct strmap *var_map
 );
 
 LLVMValueRef codegen_term(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
-	const struct strmap *var_map,
-	struct strmap *func_map
+	const struct strmap *var_map
 );
 
 LLVMValueRef codegen_expr_no_comp(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
+	const struct ast_node *node,
+	const struct strmap *var_map
+);
+
+struct codegen_value codegen_expression_value(
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
-	const struct strmap *var_map,
-	struct strmap *func_map
+	const struct strmap *var_map
 );
 
+// always an i32
 LLVMValueRef codegen_expression(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
+	const struct ast_node *node,
+	const struct strmap *var_map
+);
+
+// always an i1, for branches (an i32 is compared against 0)
+LLVMValueRef codegen_condition(
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
-	const struct strmap *var_map,
-	struct strmap *func_map
+	const struct strmap *var_map
 );
 
 #endif
@@ -2,24 +2,24 @@
 #define CODEGEN_FORLOOP_H
 
 #include <llvm-c/Core.h>
+#include "codegen/context.h"
 #include "utils/strmap.h"
 #include "ast.h"
 
 void codegen_continue(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
 	struct strmap *var_map
 );
 
 void codegen_break(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
 	const struct strmap *var_map
 );
 
 void codegen_for_loop(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
-	struct strmap *var_map,
-	struct strmap *func_map
+	struct strmap *var_map
 );
 
 #endif
@@ -2,19 +2,23 @@
 #define CODEGEN_FUNCTION_H
 
 #include <llvm-c/Core.h>
+#include "codegen/context.h"
 #include "utils/strmap.h"
 #include "ast.h"
 
-void codegen_func_init(
+// enum attribute (e.g. "nounwind") on a function or call: LLVMAttributeFunctionIndex,
+// LLVMAttributeReturnIndex or the parameter number (from 1)
+void codegen_add_attribute(
 	LLVMContextRef llvm_ctx,
-	struct strmap *func_map
+	LLVMValueRef value,
+	LLVMAttributeIndex index,
+	const char *name
 );
 
 LLVMValueRef codegen_func_call(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
-	const struct strmap *var_map,
-	struct strmap *func_map
+	const struct strmap *var_map
 );
 
 #endif
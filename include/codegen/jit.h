@@ -0,0 +1,39 @@
+#ifndef CODEGEN_JIT_H
+#define CODEGEN_JIT_H
+
+#include <llvm-c/Core.h>
+#include <llvm-c/ExecutionEngine.h>
+#include <stdbool.h>
+
+// the listeners are C++ (MCJIT only takes them in the C++ API), see jit_listener.cpp
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// what the JIT tells perf about the code it generates, a mask
+// map: /tmp/perf-<pid>.map, function names and address ranges, read by perf report as is
+// jitdump: LLVM's perf listener, a jit-<pid>.dump under ~/.debug/jit (or $JITDUMPDIR)
+// with the code and, for modules with debug info, source lines, for perf inject --jit
+enum jit_perf {
+	JIT_PERF_MAP = 1 << 0,
+	JIT_PERF_JITDUMP = 1 << 1
+};
+
+// compiles the module with MCJIT and calls its main in this process
+// the builtins are bound to this process's libc getchar/putchar
+// opt_level is the -O level (0 to 3) for the JIT's code generator
+// perf is a mask of enum jit_perf, 0 for none
+// the module is still owned (and freed) by the caller afterwards
+// returns false (after printing why) if the JIT could not be created
+bool jit_run_main(LLVMModuleRef mod, unsigned opt_level, unsigned perf, int *exit_code);
+
+// the listener writing the perf map, one for the process
+LLVMJITEventListenerRef jit_perf_map_listener(void);
+void jit_register_listener(LLVMExecutionEngineRef engine, LLVMJITEventListenerRef listener);
+void jit_unregister_listener(LLVMExecutionEngineRef engine, LLVMJITEventListenerRef listener);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
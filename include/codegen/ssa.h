@@ -0,0 +1,57 @@
+#ifndef CODEGEN_SSA_H
+#define CODEGEN_SSA_H
+
+#include <llvm-c/Core.h>
+#include <stdbool.h>
+
+// on the fly SSA construction, Braun et al. "Simple and Efficient Construction of
+// Static Single Assignment Form" (2013)
+// variables are written/read per block, phis are only created when a read
+// reaches a join point, and are removed again if they turn out to be trivial
+// blocks must be sealed once all their predecessors are known
+// in memory mode variables are instead allocas in the entry block, every write is a
+// store and every read a load (in the current block), to be promoted by mem2reg later
+
+// all state lives in the ssa_builder, one per function being generated
+struct ssa_builder;
+struct ssa_block;
+
+struct ssa_builder *ssa_new(LLVMContextRef llvm_ctx, bool memory);
+// deletes the phis removed as trivial, call before the module is verified
+void ssa_free(struct ssa_builder *ssa);
+// after an allocation failed during codegen (utils/alloc.h): only what LLVM made is freed,
+// the rest belongs to the failed compile's allocator
+void ssa_abandon(struct ssa_builder *ssa);
+
+struct ssa_block *ssa_new_block(struct ssa_builder *ssa, LLVMValueRef func, const char *name);
+void ssa_seal_block(struct ssa_builder *ssa, struct ssa_block *block);
+LLVMBasicBlockRef ssa_get_llvm_block(const struct ssa_block *block);
+
+// the block the builder is currently generating code in
+void ssa_position_at_end(struct ssa_builder *ssa, LLVMBuilderRef build, struct ssa_block *block);
+struct ssa_block *ssa_current_block(const struct ssa_builder *ssa);
+
+// build a branch from the current block and record the edge(s)
+void ssa_build_br(struct ssa_builder *ssa, LLVMBuilderRef build, struct ssa_block *dest);
+void ssa_build_cond_br(
+	struct ssa_builder *ssa,
+	LLVMBuilderRef build,
+	LLVMValueRef condition,
+	struct ssa_block *then_block,
+	struct ssa_block *else_block
+);
+
+// variable names are not copied, they must outlive the SSA construction
+// in memory mode block must be the current block
+void ssa_write_variable(
+	struct ssa_builder *ssa,
+	const char *name,
+	struct ssa_block *block,
+	LLVMValueRef value
+);
+LLVMValueRef ssa_read_variable(struct ssa_builder *ssa, const char *name, struct ssa_block *block);
+
+// number of phis that are currently in the IR (created minus removed as trivial)
+size_t ssa_phi_count(const struct ssa_builder *ssa);
+
+#endif
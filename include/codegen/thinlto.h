@@ -0,0 +1,38 @@
+#ifndef CODEGEN_THINLTO_H
+#define CODEGEN_THINLTO_H
+
+#include <llvm-c/Core.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "codegen/emit.h"
+
+// thinlto_write_bitcode is C++ (the C API cannot write summaries), see thinlto_bitcode.cpp
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// bitcode with a module summary, the index of the module's functions and references
+// a ThinLTO link plans its cross-module imports with, path can be CODEGEN_STDOUT
+// returns false (after printing why) on failure
+bool thinlto_write_bitcode(LLVMModuleRef mod, const char *path);
+
+// ThinLTO link of bitcode files written with thinlto_write_bitcode (or clang -flto=thin)
+// into an executable at path: the summaries are merged, every module imports what it calls
+// from the others and is optimized and compiled on its own thread, then cc links the objects
+// only target.cpu is used, for the code generator ("native" being the host CPU): the triple
+// comes from the modules, and libLTO has no way to set features, the optimization level or
+// debug info per link (jlang rejects --target, --mattr, -O and -g with --thinlto-link)
+// returns false (after printing why) on failure
+bool thinlto_link(
+	const char *const *inputs,
+	size_t num_inputs,
+	const struct emit_target *target,
+	const char *path
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
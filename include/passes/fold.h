@@ -0,0 +1,19 @@
+#ifndef PASSES_FOLD_H
+#define PASSES_FOLD_H
+
+#include "ast.h"
+
+// constant folding and algebraic simplification over the AST, runs between parse and codegen
+// - variables with a known constant value are replaced by it (forward over if/for,
+//   anything assigned in a loop is unknown inside and after it)
+// - constant expressions are evaluated (with i32 wraparound, division by zero is left alone)
+// - constant terms of a sum and constant factors of a product are combined,
+//   x + 0, x - 0, x * 1, x / 1 become x and x * 0 becomes 0 if x has no calls
+// - if with a constant condition keeps only the branch taken (as if (1) { ... },
+//   so scoping is unchanged), a for loop that never runs keeps only its initial
+//   assignment and an always true loop condition is removed
+// checked is for programs where overflow traps: sums and products are then only folded
+// left to right and never past an operation that overflows
+void fold_constants(struct ast_node *root, bool checked);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef PASSES_LIVENESS_H
+#define PASSES_LIVENESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ast.h"
+
+// backward liveness analysis over the AST, runs between parse and codegen
+// assignments whose value is never read (and whose right hand side has no calls)
+// are flagged AST_FLAG_DEAD_STORE, so codegen does not read the variables they use
+// and no phis are created for those reads
+// checked is for programs where overflow traps: stores whose value has +, - or *
+// are kept, evaluating them may trap
+// returns the number of assignments flagged
+size_t liveness_mark_dead_stores(struct ast_node *root, bool checked);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef PASSES_REACHABILITY_H
+#define PASSES_REACHABILITY_H
+
+#include <stddef.h>
+
+#include "ast.h"
+
+// reachability over the AST, runs between parse and codegen
+// statements after a return/break/continue, after an if whose branches all terminate
+// or after a for loop that never exits (no condition and no break) are removed
+// such statement lists, ifs and loops are flagged AST_FLAG_TERMINATES, so codegen
+// does not create the block that would follow them (it would have no predecessors)
+// loops whose body never reaches the step are flagged AST_FLAG_LOOP_ONCE
+// returns the number of statements removed
+size_t reachability_remove_dead(struct ast_node *root);
+
+#endif
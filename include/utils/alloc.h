@@ -0,0 +1,112 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+// every allocation made by the compiler is tagged with the subsystem that made it
+// each subsystem can use a different allocator and has its own statistics
+enum alloc_subsystem {
+	ALLOC_LEX,
+	ALLOC_AST,
+	ALLOC_STRMAP,
+	ALLOC_LINKEDLIST,
+	ALLOC_CODEGEN,
+	ALLOC_SUBSYSTEM_COUNT
+};
+
+// backend interface, "state" is passed back to every callback
+// sizes passed to realloc and free are the sizes originally requested from the backend
+struct allocator {
+	const char *name;
+	void *state;
+
+	void *(*alloc)(void *state, size_t size);
+	void *(*realloc)(void *state, void *ptr, size_t old_size, size_t new_size);
+	void (*free)(void *state, void *ptr, size_t size);
+};
+
+struct alloc_stats {
+	uint64_t allocs, frees, reallocs;
+	uint64_t total_bytes, live_bytes, peak_bytes;
+};
+
+// plain malloc/realloc/free, used by every subsystem by default
+extern const struct allocator alloc_system;
+
+// everything the functions below work with: the allocator of each subsystem, the
+// statistics and where a failed allocation goes
+// every thread has its own current context, by default one with alloc_system for every
+// subsystem, so compiles on separate threads (e.g. requests of a service) can each have
+// their own arena or pool and statistics: alloc_ctx_init a context and alloc_ctx_set it
+struct alloc_ctx {
+	const struct allocator *allocators[ALLOC_SUBSYSTEM_COUNT];
+	// last entry is the sum over all subsystems
+	struct alloc_stats stats[ALLOC_SUBSYSTEM_COUNT + 1];
+	// peak of the total live bytes since alloc_watch_peak
+	uint64_t watched_peak;
+
+	// see alloc_set_fail_jump, the failed allocation is kept for alloc_print_failure
+	jmp_buf *fail_jump;
+	enum alloc_subsystem fail_subsystem;
+	size_t fail_size;
+};
+
+void alloc_ctx_init(struct alloc_ctx *ctx);
+// makes ctx the current context of this thread (NULL for the thread's default one),
+// returns the previous one to restore later
+struct alloc_ctx *alloc_ctx_set(struct alloc_ctx *ctx);
+
+// only change allocators between compiles: memory must be freed by the allocator that made it
+// passing NULL restores alloc_system, the allocator struct is not copied and must outlive its use
+void alloc_set(enum alloc_subsystem subsystem, const struct allocator *allocator);
+void alloc_set_all(const struct allocator *allocator);
+
+// callers never get NULL back: when an allocator fails (out of memory, or an arena/pool at
+// its limit) the current context's fail jump is taken (longjmp with 1), from where the
+// compile is abandoned (its arena or pool can then be freed), without one the error is
+// printed and the process exits
+// returns the previous jump to restore later
+jmp_buf *alloc_set_fail_jump(jmp_buf *jump);
+// "Error: out of memory (...)" for the allocation that failed last
+void alloc_print_failure(FILE *out);
+// fails again as the last allocation did, for code that cleans up on the way out
+_Noreturn void alloc_fail_again(void);
+
+void *alloc_malloc(enum alloc_subsystem subsystem, size_t size);
+void *alloc_calloc(enum alloc_subsystem subsystem, size_t count, size_t size);
+void *alloc_realloc(enum alloc_subsystem subsystem, void *ptr, size_t size);
+void alloc_free(enum alloc_subsystem subsystem, void *ptr);
+
+const char *alloc_subsystem_to_str(enum alloc_subsystem subsystem);
+const struct alloc_stats *alloc_get_stats(enum alloc_subsystem subsystem);
+const struct alloc_stats *alloc_get_total_stats(void);
+void alloc_reset_stats(void);
+// peak of the total live bytes since alloc_watch_peak (e.g. over one phase), kept apart
+// from the peaks in alloc_stats, which stay the peaks of the whole run
+void alloc_watch_peak(void);
+uint64_t alloc_watched_peak(void);
+void alloc_print_stats(FILE *out);
+
+// arena: bump allocation out of large chunks, free is a no-op,
+// everything is released at once by alloc_arena_free
+// if limit is not 0, allocations fail (see alloc_set_fail_jump) once limit bytes are reserved
+struct alloc_arena;
+
+struct alloc_arena *alloc_arena_new(size_t limit);
+struct allocator alloc_arena_allocator(struct alloc_arena *arena);
+size_t alloc_arena_reserved(const struct alloc_arena *arena);
+void alloc_arena_free(struct alloc_arena *arena);
+
+// pool: size class free lists on top of an arena, freed blocks are reused
+// for allocations of the same class, everything is released by alloc_pool_free
+struct alloc_pool;
+
+struct alloc_pool *alloc_pool_new(size_t limit);
+struct allocator alloc_pool_allocator(struct alloc_pool *pool);
+size_t alloc_pool_reserved(const struct alloc_pool *pool);
+void alloc_pool_free(struct alloc_pool *pool);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "utils/sha256.h"
+
+// hex SHA-256 and a null terminator
+#define CACHE_KEY_SIZE (SHA256_DIGEST_SIZE * 2 + 1)
+#define CACHE_DEFAULT_MAX_BYTES (256 * 1024 * 1024)
+
+// on disk cache of compiler outputs, one file per key in dir
+// entries are written to a temporary file and renamed into place, so concurrent
+// compiles never see a partial entry, and are evicted least recently used first
+// (hits update the modification time) once the directory is over max_bytes
+// failures only print a warning, the compile then goes on without the cache
+struct cache {
+	char *dir;
+	uint64_t max_bytes;
+	// hash of the compiler executable, part of every key
+	char compiler[CACHE_KEY_SIZE];
+};
+
+// dir NULL: $JLANG_CACHE_DIR, else $XDG_CACHE_HOME/jlang, else $HOME/.cache/jlang
+// returns false (after printing why) if the directory cannot be created
+// or the compiler cannot be identified
+bool cache_open(struct cache *cache, const char *dir, uint64_t max_bytes);
+void cache_close(struct cache *cache);
+
+// key of an output: the source, the options that change the output (config, the
+// caller writes them as a string) and this compiler (a hash of the executable, which
+// is the same for a build wherever it is installed, and the LLVM version)
+void cache_make_key(
+	const struct cache *cache,
+	char key[CACHE_KEY_SIZE],
+	const char *config,
+	const char *const *lines,
+	const size_t *line_lens,
+	size_t num_lines
+);
+
+// copies the entry to path, returns false on a miss
+bool cache_fetch(const struct cache *cache, const char *key, const char *path);
+// copies path into the cache, then evicts
+void cache_store(const struct cache *cache, const char *key, const char *path);
+
+#endif
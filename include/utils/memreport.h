@@ -0,0 +1,23 @@
+#ifndef MEMREPORT_H
+#define MEMREPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define MEM_REPORT_MAX_PHASES 24
+
+// memory used by one pipeline phase
+// allocs/bytes/peak only count allocations made through utils/alloc.h,
+// rss_delta also covers LLVM and libc
+struct mem_report_phase {
+	const char *name;
+	uint64_t allocs, bytes, peak_bytes;
+	int64_t rss_delta;
+};
+
+void mem_report_begin(const char *phase);
+void mem_report_end(void);
+void mem_report_print(FILE *out, bool json);
+
+#endif
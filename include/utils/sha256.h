@@ -0,0 +1,21 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_SIZE 32
+
+// incremental SHA-256 (FIPS 180-4), for content addressed keys (utils/cache.h)
+struct sha256 {
+	uint32_t state[8];
+	uint8_t block[64];
+	size_t block_len;
+	uint64_t total_len;
+};
+
+void sha256_init(struct sha256 *hash);
+void sha256_update(struct sha256 *hash, const void *data, size_t len);
+void sha256_final(struct sha256 *hash, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+#endif
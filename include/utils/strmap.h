@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdio.h>
 
 // highly discouraged to use this struct outside of strmap.c unless necessary!!
 // might be necessary: iterating through keys/values
@@ -26,4 +27,32 @@ void *strmap_get(const struct strmap *map_ptr, const char *str);
 void *strmap_remove(struct strmap *map_ptr, const char *str, bool ret_value);
 void strmap_free(const struct strmap *map_ptr);
 
+// optional hot path counters, compiled out unless built with -DSTRMAP_STATS
+// (make STRMAP_STATS=1). counters are attributed to the codegen construct
+// that is currently being generated, see STRMAP_STATS_ENTER/LEAVE
+// the counters and the current site are per thread, each thread prints its own
+enum strmap_stats_site {
+	STRMAP_SITE_OTHER,
+	STRMAP_SITE_FOR,
+	STRMAP_SITE_IF,
+	STRMAP_SITE_BREAK_CONT,
+	STRMAP_SITE_COUNT
+};
+
+#ifdef STRMAP_STATS
+enum strmap_stats_site strmap_stats_enter(enum strmap_stats_site site);
+void strmap_stats_leave(enum strmap_stats_site prev_site);
+void strmap_stats_print(FILE *out);
+
+// ENTER declares a local holding the previous site, so use at most once per scope
+#define STRMAP_STATS_ENTER(site) \
+	enum strmap_stats_site strmap_stats_prev_site = strmap_stats_enter(site)
+#define STRMAP_STATS_LEAVE() strmap_stats_leave(strmap_stats_prev_site)
+#define STRMAP_STATS_PRINT(out) strmap_stats_print(out)
+#else
+#define STRMAP_STATS_ENTER(site)
+#define STRMAP_STATS_LEAVE() ((void) 0)
+#define STRMAP_STATS_PRINT(out) ((void) 0)
+#endif
+
 #endif
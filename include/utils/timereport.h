@@ -0,0 +1,18 @@
+#ifndef TIMEREPORT_H
+#define TIMEREPORT_H
+
+#include <stdio.h>
+
+#define TIME_REPORT_MAX_PHASES 24
+
+// seconds spent in one pipeline phase (monotonic wall clock and process cpu time)
+struct time_report_phase {
+	const char *name;
+	double wall, cpu;
+};
+
+void time_report_begin(const char *phase);
+void time_report_end(void);
+void time_report_print(FILE *out);
+
+#endif
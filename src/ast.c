@@ -4,6 +4,7 @@
 
 #include "ast.h"
 #include "lex.h"
+#include "utils/alloc.h"
 
 static const char *ast_node_type_to_str(enum ast_node_type type) {
 	switch(type) {
@@ -47,6 +48,7 @@ struct ast_node ast_new_node(enum ast_node_type type) {
 	return (struct ast_node) {
 		.value.children = ast_new_node_list(),
 		.type = type,
+		.flags = 0,
 	};
 }
 
@@ -69,7 +71,7 @@ struct ast_node_list ast_new_node_list(void) {
 void ast_node_list_append(struct ast_node_list *list, struct ast_node node) {
 	if (list->capacity == 0) {
 		list->capacity = 1, list->size = 1;
-		list->l = malloc(1 * sizeof(struct ast_node));
+		list->l = alloc_malloc(ALLOC_AST, 1 * sizeof(struct ast_node));
 		list->l[0] = node;
 		return;
 	}
@@ -79,14 +81,14 @@ void ast_node_list_append(struct ast_node_list *list, struct ast_node node) {
 	}
 
 	list->capacity *= 2;
-	list->l = realloc(list->l, list->capacity * sizeof(struct ast_node));
+	list->l = alloc_realloc(ALLOC_AST, list->l, list->capacity * sizeof(struct ast_node));
 	list->l[list->size++] = node;
 }
 
 void ast_free_node_list(struct ast_node_list *list) {
 	for (size_t i = 0; i < list->size; i++)
 		ast_free_node(&list->l[i]);
-	free(list->l);
+	alloc_free(ALLOC_AST, list->l);
 	list->capacity = 0, list->size = 0;
 }
 
@@ -100,6 +102,7 @@ size_t ast_insert_node(struct ast_node *node, enum ast_node_type type) {
 
 	struct ast_node new_node;
 	new_node.type = type;
+	new_node.flags = 0;
 	new_node.value.children = ast_new_node_list();
 	ast_node_list_append(list, new_node);
 
@@ -114,6 +117,7 @@ size_t ast_insert_leaf(struct ast_node *node, const struct lex_token *token) {
 
 	struct ast_node new_node;
 	new_node.type = AST_LEAF;
+	new_node.flags = 0;
 	new_node.value.token = *token;
 	ast_node_list_append(list, new_node);
 
@@ -136,6 +140,46 @@ bool ast_remove_node(struct ast_node *node, size_t index) {
 	return true;
 }
 
+// deep copy, tokens are copied by value (strings are shared)
+struct ast_node ast_copy_node(const struct ast_node *node) {
+	if (node->type == AST_LEAF)
+		return *node;
+
+	struct ast_node copy = ast_new_node(node->type);
+	copy.flags = node->flags;
+	for (size_t i = 0; i < node->value.children.size; i++)
+		ast_node_list_append(&copy.value.children, ast_copy_node(&node->value.children.l[i]));
+	return copy;
+}
+
+// whether there is a node of this type anywhere in the tree (including node itself)
+bool ast_contains(const struct ast_node *node, enum ast_node_type type) {
+	if (node->type == type)
+		return true;
+	if (node->type == AST_LEAF)
+		return false;
+
+	for (size_t i = 0; i < node->value.children.size; i++) {
+		if (ast_contains(&node->value.children.l[i], type))
+			return true;
+	}
+	return false;
+}
+
+// whether the node is just a number literal (a chain of single children down to it)
+bool ast_get_constant(const struct ast_node *node, int32_t *value) {
+	while (node->type != AST_LEAF) {
+		if (node->value.children.size != 1)
+			return false;
+		node = &node->value.children.l[0];
+	}
+	if (node->value.token.type != LEX_NUMBER)
+		return false;
+
+	*value = node->value.token.literal.number;
+	return true;
+}
+
 
 
 
@@ -164,7 +208,7 @@ static void ast_queue_append(
 	const struct ast_node *node,
 	size_t level, size_t parent_id
 ) {
-	struct ast_ll_node *new_node = malloc(sizeof(struct ast_ll_node));
+	struct ast_ll_node *new_node = alloc_malloc(ALLOC_AST, sizeof(struct ast_ll_node));
 	new_node->next = NULL;
 	new_node->data = (struct ast_ll_node_data) {
 		.node = node, .level = level, .parent_id = parent_id
@@ -189,7 +233,7 @@ struct ast_ll_node_data ast_queue_pop(struct ast_queue *queue) {
 	if (queue->head == NULL)
 		queue->tail = NULL;
 
-	free(cur_head);
+	alloc_free(ALLOC_AST, cur_head);
 
 	return data;
 }
@@ -7,15 +7,15 @@
 
 #include "codegen/assignment.h"
 #include "codegen/expression.h"
+#include "codegen/ssa.h"
 #include "utils/strmap.h"
 #include "ast.h"
 #include "lex.h"
 
 void codegen_assignment(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
-	struct strmap *var_map,
-	struct strmap *func_map
+	struct strmap *var_map
 ) {
 	if (node->type != AST_ASSIGN) {
 		fprintf(stderr, "ERROR! (12)\n");
@@ -30,7 +30,18 @@ void codegen_assignment(
 	}
 
 	const struct lex_token *ident = &list->l[0].value.token;
-	LLVMValueRef rhs = codegen_expression(build, &list->l[1], var_map, func_map);
-	strmap_set(var_map, ident->str, &rhs, sizeof(LLVMValueRef));
+
+	// var_map only tracks which variables are in scope, values live in the SSA tables
+	bool in_scope = true;
+
+	// the value is never read (see passes/liveness.h), but the variable still comes into scope
+	if (node->flags & AST_FLAG_DEAD_STORE) {
+		strmap_set(var_map, ident->str, &in_scope, sizeof(in_scope));
+		return;
+	}
+
+	LLVMValueRef rhs = codegen_expression(ctx, &list->l[1], var_map);
+	strmap_set(var_map, ident->str, &in_scope, sizeof(in_scope));
+	ssa_write_variable(ctx->ssa, ident->str, ssa_current_block(ctx->ssa), rhs);
 }
 
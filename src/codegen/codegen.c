@@ -4,73 +4,206 @@
 #include <llvm-c/Target.h>
 #include <llvm-c/Analysis.h>
 #include <llvm-c/BitWriter.h>
+#include <llvm-c/Support.h>
+#include <llvm-c/Error.h>
+#include <llvm-c/Transforms/PassBuilder.h>
 
 #include <inttypes.h>
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "codegen/codegen.h"
+#include "codegen/context.h"
+#include "codegen/debug.h"
 #include "codegen/function.h"
 #include "codegen/statement.h"
+#include "codegen/ssa.h"
+#include "utils/alloc.h"
 #include "utils/strmap.h"
 #include "ast.h"
 
-LLVMModuleRef module = NULL;
+// turn on LLVM's -time-passes, LLVM prints its timers to stderr once its passes have run
+void codegen_enable_time_passes(void) {
+	const char *args[] = { "jlang", "-time-passes" };
+	LLVMParseCommandLineOptions(2, args, NULL);
+}
+
+// run a new pass manager pipeline (as for opt -passes=...) on the module
+// machine may be NULL, the passes then have no target specific cost information
+// returns false (after printing why) if the pipeline is invalid
+static bool run_passes(LLVMModuleRef mod, const char *pipeline, LLVMTargetMachineRef machine) {
+	LLVMPassBuilderOptionsRef options = LLVMCreatePassBuilderOptions();
+	LLVMErrorRef error = LLVMRunPasses(mod, pipeline, machine, options);
+	LLVMDisposePassBuilderOptions(options);
 
-LLVMModuleRef codegen_get_current_module(void) {
-	return module;
+	if (error != NULL) {
+		char *message = LLVMGetErrorMessage(error);
+		fprintf(stderr, "Error: pass pipeline \"%s\": %s\n", pipeline, message);
+		LLVMDisposeErrorMessage(message);
+		return false;
+	}
+	return true;
 }
 
-bool codegen(const char *name, const struct ast_node *root) {
-	LLVMContextRef llvm_ctx = LLVMContextCreate();
+// promote the allocas made in memory mode to registers
+static void run_mem2reg(LLVMModuleRef mod) {
+	if (!run_passes(mod, "mem2reg", NULL)) {
+		fprintf(stderr, "ERROR! mem2reg\n");
+		exit(1);
+	}
+}
 
-    module = LLVMModuleCreateWithNameInContext(name, llvm_ctx);
+bool codegen_optimize(LLVMModuleRef mod, const char *pipeline, LLVMTargetMachineRef machine) {
+	return run_passes(mod, pipeline, machine);
+}
 
-    LLVMTypeRef param_types[] = { };
-    LLVMTypeRef ret_type = LLVMFunctionType(
-		LLVMInt32TypeInContext(llvm_ctx), param_types, 0, 0
+// everything codegen does that allocates through utils/alloc.h
+static void generate(struct codegen_ctx *ctx, const struct ast_node *root, const struct codegen_options *options) {
+	LLVMTypeRef param_types[] = { };
+	LLVMTypeRef ret_type = LLVMFunctionType(
+		LLVMInt32TypeInContext(ctx->llvm_ctx), param_types, 0, 0
 	);
-    LLVMValueRef main_func = LLVMAddFunction(module, "main", ret_type);
+	LLVMValueRef main_func = LLVMAddFunction(ctx->module, "main", ret_type);
+	// nothing in the language throws (llvm.trap for --overflow=trap does not unwind)
+	codegen_add_attribute(ctx->llvm_ctx, main_func, LLVMAttributeFunctionIndex, "nounwind");
 
-    LLVMBasicBlockRef entry = LLVMAppendBasicBlockInContext(
-		llvm_ctx, main_func, "entry"
-	);
+	if (options->debug_file != NULL)
+		codegen_debug_begin(ctx, main_func, options->debug_file, root);
 
-    LLVMBuilderRef builder = LLVMCreateBuilderInContext(llvm_ctx);
-    LLVMPositionBuilderAtEnd(builder, entry);
+	bool memory = options->lowering == CODEGEN_LOWERING_MEMORY;
+
+	ctx->ssa = ssa_new(ctx->llvm_ctx, memory);
+	struct ssa_block *entry = ssa_new_block(ctx->ssa, main_func, "entry");
+	ssa_seal_block(ctx->ssa, entry);
+	ssa_position_at_end(ctx->ssa, ctx->build, entry);
 
 	// codegen_test(module, builder);
 
-	struct strmap var_map = strmap_new(), func_map = strmap_new();
-	codegen_func_init(llvm_ctx, &func_map);
-	codegen_stmt_list(builder, &root->value.children.l[0], &var_map, &func_map);
+	// func_map caches the declarations made in this module (builtins are declared on first call)
+	ctx->func_map = strmap_new();
+	ctx->loop = NULL;
+	ctx->overflow = options->overflow;
+	ctx->trap_block = NULL;
 
-	char *error = NULL;
-	LLVMVerifyModule(module, LLVMAbortProcessAction, &error);
-	LLVMDisposeMessage(error);
-
-	size_t len = strlen(name);
-	len += 4; // ".bc" and a null terminator
-	char *bitcode_filename = malloc(len * sizeof(char));
-	strcpy(bitcode_filename, name);
-	strcat(bitcode_filename, ".bc");
-	
-    // Write out bitcode to file
-	if (LLVMWriteBitcodeToFile(module, bitcode_filename) != 0)
-		fprintf(stderr, "error writing bitcode to file, skipping\n");
+	struct strmap var_map = strmap_new();
+	codegen_stmt_list(ctx, &root->value.children.l[0], &var_map);
+	if (ctx->trap_block != NULL)
+		ssa_seal_block(ctx->ssa, ctx->trap_block);
+
+	ssa_free(ctx->ssa);
+	ctx->ssa = NULL;
+	codegen_debug_finish(ctx);
 
-	free(bitcode_filename);
 	strmap_free(&var_map);
-	strmap_free(&func_map);
+	strmap_free(&ctx->func_map);
+}
+
+// generate with a fail jump of its own, returns false if an allocation failed
+// (a function of its own, so that ctx is not a local of the function calling setjmp)
+static bool try_generate(struct codegen_ctx *ctx, const struct ast_node *root, const struct codegen_options *options) {
+	jmp_buf jump;
+	jmp_buf *prev = alloc_set_fail_jump(&jump);
+	bool ok = false;
+	if (!setjmp(jump)) {
+		generate(ctx, root, options);
+		ok = true;
+	}
+	alloc_set_fail_jump(prev);
+	return ok;
+}
+
+// returns the generated module, the caller owns it and must free it with codegen_dispose
+// every call works in its own LLVM context and codegen_ctx, see codegen/context.h
+// if an allocation fails, LLVM's objects are freed before the failure goes on to the
+// caller's fail jump (utils/alloc.h), the rest is left to the compile's allocator
+LLVMModuleRef codegen(const char *name, const struct ast_node *root, const struct codegen_options *options) {
+	struct codegen_ctx ctx;
+	ctx.llvm_ctx = LLVMContextCreate();
+	// the names passed to the builder are dropped as soon as they are given
+	LLVMContextSetDiscardValueNames(ctx.llvm_ctx, options->discard_names);
+	ctx.module = LLVMModuleCreateWithNameInContext(name, ctx.llvm_ctx);
+	ctx.build = LLVMCreateBuilderInContext(ctx.llvm_ctx);
+	ctx.ssa = NULL;
+	ctx.di_build = NULL;
+	ctx.di_scope = NULL;
+
+	if (!try_generate(&ctx, root, options)) {
+		if (ctx.ssa != NULL)
+			ssa_abandon(ctx.ssa);
+		// finalized, or its temporary metadata outlives the context
+		codegen_debug_finish(&ctx);
+		LLVMDisposeBuilder(ctx.build);
+		// and the module with it
+		LLVMContextDispose(ctx.llvm_ctx);
+		alloc_fail_again();
+	}
+
+	if (options->verify) {
+		char *error = NULL;
+		LLVMVerifyModule(ctx.module, LLVMAbortProcessAction, &error);
+		LLVMDisposeMessage(error);
+	}
 
-    LLVMDisposeBuilder(builder);
-    LLVMDisposeModule(module);
-    LLVMContextDispose(llvm_ctx);
+	if (options->lowering == CODEGEN_LOWERING_MEMORY)
+		run_mem2reg(ctx.module);
 
+	STRMAP_STATS_PRINT(stderr);
+
+	LLVMDisposeBuilder(ctx.build);
+
+	return ctx.module;
+}
+
+bool codegen_write_stdout(const char *data, size_t size) {
+	if (fwrite(data, 1, size, stdout) != size || fflush(stdout) != 0) {
+		fprintf(stderr, "Error: writing to stdout failed\n");
+		return false;
+	}
+	return true;
+}
+
+// writes the bitcode to path, to stdout it goes through a buffer in memory
+bool codegen_write_bitcode(LLVMModuleRef mod, const char *path) {
+	if (strcmp(path, CODEGEN_STDOUT) == 0) {
+		LLVMMemoryBufferRef buffer = LLVMWriteBitcodeToMemoryBuffer(mod);
+		bool ok = codegen_write_stdout(LLVMGetBufferStart(buffer), LLVMGetBufferSize(buffer));
+		LLVMDisposeMemoryBuffer(buffer);
+		return ok;
+	}
+
+	if (LLVMWriteBitcodeToFile(mod, path) != 0) {
+		fprintf(stderr, "error writing bitcode to file, skipping\n");
+		return false;
+	}
+	return true;
+}
+
+bool codegen_write_ir(LLVMModuleRef mod, const char *path) {
+	if (strcmp(path, CODEGEN_STDOUT) == 0) {
+		char *ir = LLVMPrintModuleToString(mod);
+		bool ok = codegen_write_stdout(ir, strlen(ir));
+		LLVMDisposeMessage(ir);
+		return ok;
+	}
+
+	char *error = NULL;
+	if (LLVMPrintModuleToFile(mod, path, &error) != 0) {
+		fprintf(stderr, "Error: writing %s: %s\n", path, error);
+		LLVMDisposeMessage(error);
+		return false;
+	}
 	return true;
 }
 
+// frees the module and the context it was created in
+void codegen_dispose(LLVMModuleRef mod) {
+	LLVMContextRef llvm_ctx = LLVMGetModuleContext(mod);
+	LLVMDisposeModule(mod);
+	LLVMContextDispose(llvm_ctx);
+}
+
 
 
 // void codegen_test(
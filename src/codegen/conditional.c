@@ -9,183 +9,253 @@
 #include "codegen/conditional.h"
 #include "codegen/statement.h"
 #include "codegen/expression.h"
+#include "codegen/ssa.h"
 #include "utils/strmap.h"
 #include "ast.h"
 
 static void codegen_conditional_if_then(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
 	struct strmap *var_map,
-	struct strmap *func_map,
 	LLVMValueRef condition
 ) {
-	LLVMContextRef llvm_ctx = LLVMGetBuilderContext(build);
-	LLVMValueRef func = LLVMGetBasicBlockParent(LLVMGetInsertBlock(build));
+	LLVMValueRef func = LLVMGetBasicBlockParent(LLVMGetInsertBlock(ctx->build));
 
-	LLVMBasicBlockRef before_block = LLVMGetInsertBlock(build);
-	LLVMBasicBlockRef then_block = LLVMAppendBasicBlockInContext(
-		llvm_ctx, func, "ifthen"
-	);
-	LLVMBasicBlockRef after_block = LLVMAppendBasicBlockInContext(
-		llvm_ctx, func, "ifcont"
-	);
+	struct ssa_block *then_block = ssa_new_block(ctx->ssa, func, "ifthen");
+	struct ssa_block *after_block = ssa_new_block(ctx->ssa, func, "ifcont");
 
-	LLVMBuildCondBr(build, condition, then_block, after_block);
+	ssa_build_cond_br(ctx->ssa, ctx->build, condition, then_block, after_block);
+	ssa_seal_block(ctx->ssa, then_block);
 
-	LLVMPositionBuilderAtEnd(build, then_block);
+	// variables first assigned in the block go out of scope after it
+	ssa_position_at_end(ctx->ssa, ctx->build, then_block);
 	struct strmap var_map_then = strmap_copy(var_map);
-	bool terminated = codegen_stmt_list(build, &node->value.children.l[1], &var_map_then, func_map);
+	bool terminated = codegen_stmt_list(ctx, &node->value.children.l[1], &var_map_then);
 	if (!terminated)
-		LLVMBuildBr(build, after_block);
-	then_block = LLVMGetInsertBlock(build);
-
-	LLVMPositionBuilderAtEnd(build, after_block);
-
-	// iterate through ALREADY DEFINED variables and assign with phi nodesconditio
-	// but only do this if they have been modified by either block
-	for (uint64_t i = 0; i < var_map->bucket_count; i++) {
-		struct strmap_list_node *cur_before = var_map->list[i];
-		while (cur_before != NULL) {
-			LLVMValueRef value_before = *(LLVMValueRef *) cur_before->value;
-			LLVMValueRef value_then = *(LLVMValueRef *) strmap_get(&var_map_then, cur_before->str);
-
-			// if conditional does not affect value, no need for phi
-			if (value_before == value_then) {
-				cur_before = cur_before->next;
-				continue;
-			}
+		ssa_build_br(ctx->ssa, ctx->build, after_block);
 
-			LLVMValueRef phi = LLVMBuildPhi(
-				build,
-				LLVMInt32TypeInContext(llvm_ctx),
-				"ifphitmp"
-			);
-			LLVMAddIncoming(phi, &value_then, &then_block, 1);
-			LLVMAddIncoming(phi, &value_before, &before_block, 1);
+	// phis for modified variables are created when (and if) they are read
+	ssa_seal_block(ctx->ssa, after_block);
+	ssa_position_at_end(ctx->ssa, ctx->build, after_block);
 
-			strmap_set(var_map, cur_before->str, &phi, sizeof(LLVMValueRef));
-
-			cur_before = cur_before->next;
-		}
-	}
-	
 	strmap_free(&var_map_then);
 }
 
 static void codegen_conditional_if_then_else(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
 	struct strmap *var_map,
-	struct strmap *func_map,
 	LLVMValueRef condition
 ) {
-	LLVMContextRef llvm_ctx = LLVMGetBuilderContext(build);
-	LLVMValueRef func = LLVMGetBasicBlockParent(LLVMGetInsertBlock(build));
+	LLVMValueRef func = LLVMGetBasicBlockParent(LLVMGetInsertBlock(ctx->build));
 
-	LLVMBasicBlockRef then_block = LLVMAppendBasicBlockInContext(
-		llvm_ctx, func, "ifthen"
-	);
-	LLVMBasicBlockRef else_block = LLVMAppendBasicBlockInContext(
-		llvm_ctx, func, "ifelse"
-	);
-	LLVMBasicBlockRef merge_block = LLVMAppendBasicBlockInContext(
-		llvm_ctx, func, "ifcont"
-	);
+	struct ssa_block *then_block = ssa_new_block(ctx->ssa, func, "ifthen");
+	struct ssa_block *else_block = ssa_new_block(ctx->ssa, func, "ifelse");
+	// when both branches terminate, nothing follows the if
+	struct ssa_block *merge_block = NULL;
+	if (!(node->flags & AST_FLAG_TERMINATES))
+		merge_block = ssa_new_block(ctx->ssa, func, "ifcont");
 
-	LLVMBuildCondBr(build, condition, then_block, else_block);
+	ssa_build_cond_br(ctx->ssa, ctx->build, condition, then_block, else_block);
+	ssa_seal_block(ctx->ssa, then_block);
+	ssa_seal_block(ctx->ssa, else_block);
 
 	// generate then block and add merge block to terminate it
-	LLVMPositionBuilderAtEnd(build, then_block);
+	ssa_position_at_end(ctx->ssa, ctx->build, then_block);
 	struct strmap var_map_then = strmap_copy(var_map);
-	codegen_stmt_list(build, &node->value.children.l[1], &var_map_then, func_map);
-
-	LLVMBuildBr(build, merge_block);
-	then_block = LLVMGetInsertBlock(build);
+	if (!codegen_stmt_list(ctx, &node->value.children.l[1], &var_map_then))
+		ssa_build_br(ctx->ssa, ctx->build, merge_block);
 
 	// generate else block and add merge block to terminate it
-	LLVMPositionBuilderAtEnd(build, else_block);
+	ssa_position_at_end(ctx->ssa, ctx->build, else_block);
 	struct strmap var_map_else = strmap_copy(var_map);
-	codegen_stmt_list(build, &node->value.children.l[2], &var_map_else, func_map);
-
-	LLVMBuildBr(build, merge_block);
-	else_block = LLVMGetInsertBlock(build);
-
-	// deal with merge blocks and add phi nodes
-	LLVMPositionBuilderAtEnd(build, merge_block);
-
-	// iterate through ALREADY DEFINED variables and assign with phi nodes
-	// but only do this if they have been modified by either block
-	for (uint64_t i = 0; i < var_map->bucket_count; i++) {
-		struct strmap_list_node *cur = var_map->list[i];
-		while (cur != NULL) {
-			LLVMValueRef value_cur = *(LLVMValueRef *) cur->value;
-			LLVMValueRef value_then = *(LLVMValueRef *) strmap_get(&var_map_then, cur->str);
-			LLVMValueRef value_else = *(LLVMValueRef *) strmap_get(&var_map_else, cur->str);
-
-			// if conditional does not affect value, no need for phi
-			if (value_cur == value_then && value_cur == value_else) {
-				cur = cur->next;
-				continue;
-			}
+	if (!codegen_stmt_list(ctx, &node->value.children.l[2], &var_map_else))
+		ssa_build_br(ctx->ssa, ctx->build, merge_block);
 
-			LLVMValueRef phi = LLVMBuildPhi(
-				build,
-				LLVMInt32TypeInContext(llvm_ctx),
-				"ifelsephitmp"
-			);
-			LLVMAddIncoming(phi, &value_then, &then_block, 1);
-			LLVMAddIncoming(phi, &value_else, &else_block, 1);
+	// phis for modified variables are created when (and if) they are read
+	if (merge_block != NULL) {
+		ssa_seal_block(ctx->ssa, merge_block);
+		ssa_position_at_end(ctx->ssa, ctx->build, merge_block);
+	}
 
-			strmap_set(var_map, cur->str, &phi, sizeof(LLVMValueRef));
+	strmap_free(&var_map_then);
+	strmap_free(&var_map_else);
+}
+
+// constant condition (see passes/fold.h): no branch, only the statement list
+// taken is generated, still in its own scope
+// returns true if it terminates (as passes/reachability.h flags the if then)
+static bool codegen_conditional_constant(
+	struct codegen_ctx *ctx,
+	const struct ast_node *node,
+	struct strmap *var_map,
+	bool taken
+) {
+	const struct ast_node *stmt_list = NULL;
+	if (taken)
+		stmt_list = &node->value.children.l[1];
+	else if (node->value.children.size == 3)
+		stmt_list = &node->value.children.l[2];
+	if (stmt_list == NULL)
+		return false;
 
-			cur = cur->next;
+	struct strmap var_map_taken = strmap_copy(var_map);
+	bool terminated = codegen_stmt_list(ctx, stmt_list, &var_map_taken);
+	strmap_free(&var_map_taken);
+	return terminated;
+}
+
+// whether node can be evaluated even when the branch it is in is not taken
+// calls have side effects, division by 0 (or of INT_MIN by -1) traps,
+// and so does any arithmetic with --overflow=trap
+static bool is_speculatable(const struct codegen_ctx *ctx, const struct ast_node *node) {
+	if (node->type == AST_LEAF)
+		return true;
+	if (node->type == AST_FUNC_CALL)
+		return false;
+
+	const struct ast_node_list *list = &node->value.children;
+	if (ctx->overflow == CODEGEN_OVERFLOW_TRAP &&
+		(node->type == AST_TERM || node->type == AST_EXPR_NO_COMP) && list->size > 1)
+		return false;
+
+	if (node->type == AST_TERM) {
+		for (size_t i = 1; i + 1 < list->size; i += 2) {
+			enum lex_token_type op = list->l[i].value.token.type;
+			int32_t divisor;
+			if ((op == LEX_SLASH || op == LEX_PERCENT) &&
+				(!ast_get_constant(&list->l[i + 1], &divisor) || divisor == 0 || divisor == -1))
+				return false;
 		}
 	}
-	
-	strmap_free(&var_map_then);
-	strmap_free(&var_map_else);
+
+	for (size_t i = 0; i < list->size; i++) {
+		if (!is_speculatable(ctx, &list->l[i]))
+			return false;
+	}
+	return true;
+}
+
+static bool is_select_branch(const struct codegen_ctx *ctx, const struct ast_node *stmt_list) {
+	const struct ast_node_list *list = &stmt_list->value.children;
+	if (list->size > CODEGEN_SELECT_MAX_ASSIGNS)
+		return false;
+
+	for (size_t i = 0; i < list->size; i++) {
+		const struct ast_node *child = &list->l[i].value.children.l[0];
+		if (child->type != AST_ASSIGN || !is_speculatable(ctx, &child->value.children.l[1]))
+			return false;
+	}
+	return true;
 }
 
-// will modify var_map using phi nodes
-void codegen_conditional(
-	LLVMBuilderRef build,
+// value of a variable assigned in a branch, before the if and at the end of the then branch
+struct select_var {
+	LLVMValueRef before, then_value;
+};
+
+// at the end of the then branch (condition NULL) each variable is restored to its value
+// from before the if for the else branch, at the end of the else branch it gets a select
+static void end_select_branch(struct codegen_ctx *ctx, struct strmap *vars, LLVMValueRef condition) {
+	struct ssa_block *block = ssa_current_block(ctx->ssa);
+	for (uint64_t i = 0; i < vars->bucket_count; i++) {
+		for (struct strmap_list_node *cur = vars->list[i]; cur != NULL; cur = cur->next) {
+			struct select_var *var = cur->value;
+			LLVMValueRef value = ssa_read_variable(ctx->ssa, cur->str, block);
+
+			if (condition == NULL) {
+				var->then_value = value;
+				ssa_write_variable(ctx->ssa, cur->str, block, var->before);
+			}
+			else if (value != var->then_value) {
+				LLVMValueRef result = LLVMBuildSelect(
+					ctx->build, condition, var->then_value, value, "seltmp"
+				);
+				ssa_write_variable(ctx->ssa, cur->str, block, result);
+			}
+		}
+	}
+}
+
+// both branches are generated in the current block, one after the other, and every
+// variable they assign that is still in scope after the if gets a select
+static void codegen_conditional_select(
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
 	struct strmap *var_map,
-	struct strmap *func_map
+	LLVMValueRef condition
 ) {
-	LLVMContextRef llvm_ctx = LLVMGetBuilderContext(build);
-	LLVMValueRef func = LLVMGetBasicBlockParent(LLVMGetInsertBlock(build));
+	const struct ast_node_list *list = &node->value.children;
 
-	LLVMBasicBlockRef cond_block = LLVMAppendBasicBlockInContext(
-		llvm_ctx, func, "ifcond"
-	);
-	LLVMBuildBr(build, cond_block);
-	LLVMPositionBuilderAtEnd(build, cond_block);
+	struct strmap vars = strmap_new();
+	for (size_t branch = 1; branch < list->size; branch++) {
+		const struct ast_node_list *stmts = &list->l[branch].value.children;
+		for (size_t i = 0; i < stmts->size; i++) {
+			const char *name = stmts->l[i].value.children.l[0].value.children.l[0].value.token.str;
+			if (strmap_get(var_map, name) == NULL || strmap_get(&vars, name) != NULL)
+				continue;
+
+			struct select_var var = {
+				.before = ssa_read_variable(ctx->ssa, name, ssa_current_block(ctx->ssa)),
+				.then_value = NULL
+			};
+			strmap_set(&vars, name, &var, sizeof(var));
+		}
+	}
+
+	// variables first assigned in a branch still go out of scope after it
+	for (size_t branch = 1; branch < 3; branch++) {
+		if (branch < list->size) {
+			struct strmap var_map_branch = strmap_copy(var_map);
+			codegen_stmt_list(ctx, &list->l[branch], &var_map_branch);
+			strmap_free(&var_map_branch);
+		}
+		end_select_branch(ctx, &vars, branch == 1 ? NULL : condition);
+	}
 
-	LLVMValueRef condition = codegen_expression(
-		build,
+	strmap_free(&vars);
+}
+
+// variables assigned inside are merged by the SSA construction, see codegen/ssa.h
+// returns true if control does not continue after the if
+bool codegen_conditional(
+	struct codegen_ctx *ctx,
+	const struct ast_node *node,
+	struct strmap *var_map
+) {
+	STRMAP_STATS_ENTER(STRMAP_SITE_IF);
+
+	LLVMValueRef condition = codegen_condition(
+		ctx,
 		&node->value.children.l[0],
-		var_map, func_map
+		var_map
 	);
 	if (condition == NULL) {
 		fprintf(stderr, "ERROR! (19)\n");
 		exit(1);
 	}
-	condition = LLVMBuildICmp(
-		build, LLVMIntNE, condition,
-		LLVMConstInt(LLVMInt32TypeInContext(llvm_ctx), 0, 0),
-		"ifcmptmp"
-	);
 
+	// only conditions the AST has as constant, like passes/reachability.h, which decides
+	// what follows the if (LLVM also folds e.g. variables only the SSA form knows)
+	int32_t constant;
+	bool terminated = (node->flags & AST_FLAG_TERMINATES) != 0;
+	if (ast_get_constant(&node->value.children.l[0], &constant))
+		terminated = codegen_conditional_constant(ctx, node, var_map, constant != 0);
+	else if (is_select_branch(ctx, &node->value.children.l[1]) &&
+		(node->value.children.size == 2 || is_select_branch(ctx, &node->value.children.l[2])))
+		codegen_conditional_select(ctx, node, var_map, condition);
 	// 2 = no else (if then)
-	if (node->value.children.size == 2)
-		codegen_conditional_if_then(build, node, var_map, func_map, condition);
+	else if (node->value.children.size == 2)
+		codegen_conditional_if_then(ctx, node, var_map, condition);
 	// 3 = has else (if then else)
 	else if (node->value.children.size == 3)
-		codegen_conditional_if_then_else(build, node, var_map, func_map, condition);
+		codegen_conditional_if_then_else(ctx, node, var_map, condition);
 	else {
 		fprintf(stderr, "ERROR! (20)");
 		exit(1);
 	}
+
+	STRMAP_STATS_LEAVE();
+	return terminated;
 }
 
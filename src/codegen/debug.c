@@ -0,0 +1,88 @@
+#include <llvm-c/Core.h>
+#include <llvm-c/DebugInfo.h>
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "codegen/debug.h"
+#include "ast.h"
+
+#define DEBUG_PRODUCER "jlang"
+// DW_ATE_signed, the encoding of int
+#define DEBUG_ATE_SIGNED 0x05
+
+// line of the first token in node, 0 if it has none
+static unsigned first_line(const struct ast_node *node) {
+	if (node->type == AST_LEAF)
+		return node->value.token.line;
+
+	for (size_t i = 0; i < node->value.children.size; i++) {
+		unsigned line = first_line(&node->value.children.l[i]);
+		if (line != 0)
+			return line;
+	}
+	return 0;
+}
+
+void codegen_debug_begin(struct codegen_ctx *ctx, LLVMValueRef main_func, const char *path, const struct ast_node *root) {
+	ctx->di_build = LLVMCreateDIBuilder(ctx->module);
+
+	// relative paths are resolved against the directory of the compile, as with clang
+	char dir[PATH_MAX];
+	if (path[0] == '/' || getcwd(dir, sizeof(dir)) == NULL)
+		dir[0] = 0;
+	LLVMMetadataRef file = LLVMDIBuilderCreateFile(ctx->di_build, path, strlen(path), dir, strlen(dir));
+
+	// C is the closest language debuggers know, main is an int function in either
+	LLVMMetadataRef unit = LLVMDIBuilderCreateCompileUnit(
+		ctx->di_build, LLVMDWARFSourceLanguageC, file,
+		DEBUG_PRODUCER, strlen(DEBUG_PRODUCER), false, "", 0, 0, "", 0,
+		LLVMDWARFEmissionFull, 0, false, false, "", 0, "", 0
+	);
+
+	LLVMMetadataRef int_type = LLVMDIBuilderCreateBasicType(
+		ctx->di_build, "int", strlen("int"), 32, DEBUG_ATE_SIGNED, LLVMDIFlagZero
+	);
+	// the first type is the return type
+	LLVMMetadataRef main_type = LLVMDIBuilderCreateSubroutineType(
+		ctx->di_build, file, &int_type, 1, LLVMDIFlagZero
+	);
+
+	unsigned line = first_line(root);
+	ctx->di_scope = LLVMDIBuilderCreateFunction(
+		ctx->di_build, unit, "main", strlen("main"), "main", strlen("main"),
+		file, line, main_type, false, true, line, LLVMDIFlagPrototyped, false
+	);
+	LLVMSetSubprogram(main_func, ctx->di_scope);
+
+	// LLVM strips debug info without a version it knows when the bitcode is read
+	LLVMAddModuleFlag(
+		ctx->module, LLVMModuleFlagBehaviorWarning, "Debug Info Version", strlen("Debug Info Version"),
+		LLVMValueAsMetadata(LLVMConstInt(LLVMInt32TypeInContext(ctx->llvm_ctx), LLVMDebugMetadataVersion(), 0))
+	);
+}
+
+void codegen_debug_location(struct codegen_ctx *ctx, const struct ast_node *node) {
+	if (ctx->di_build == NULL)
+		return;
+
+	unsigned line = first_line(node);
+	if (line == 0)
+		return;
+
+	LLVMMetadataRef location = LLVMDIBuilderCreateDebugLocation(ctx->llvm_ctx, line, 0, ctx->di_scope, NULL);
+	LLVMSetCurrentDebugLocation2(ctx->build, location);
+}
+
+// resolves what the subprogram and compile unit refer to, before the module is verified
+void codegen_debug_finish(struct codegen_ctx *ctx) {
+	if (ctx->di_build == NULL)
+		return;
+
+	LLVMDIBuilderFinalize(ctx->di_build);
+	LLVMDisposeDIBuilder(ctx->di_build);
+	ctx->di_build = NULL;
+}
@@ -0,0 +1,208 @@
+#include <llvm-c/Core.h>
+#include <llvm-c/Target.h>
+#include <llvm-c/TargetMachine.h>
+
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "codegen/codegen.h"
+#include "codegen/emit.h"
+
+extern char **environ;
+
+// the driver finds the C runtime and libc for the link
+#define EMIT_LINKER "cc"
+
+// features of cpu plus extra (either can be NULL), NULL on malloc failure
+static char *join_features(const char *cpu_features, const char *extra) {
+	if (cpu_features == NULL || cpu_features[0] == 0)
+		cpu_features = extra;
+	else if (extra != NULL && extra[0] != 0) {
+		char *features = malloc(strlen(cpu_features) + 1 + strlen(extra) + 1);
+		if (features != NULL)
+			sprintf(features, "%s,%s", cpu_features, extra);
+		return features;
+	}
+	return strdup(cpu_features != NULL ? cpu_features : "");
+}
+
+LLVMTargetMachineRef emit_create_target_machine(const struct emit_target *target, unsigned opt_level) {
+	// only the host's backend unless another target is asked for
+	char *triple;
+	if (target->triple == NULL) {
+		if (LLVMInitializeNativeTarget() != 0 || LLVMInitializeNativeAsmPrinter() != 0) {
+			fprintf(stderr, "Error: LLVM has no support for the host target\n");
+			return NULL;
+		}
+		triple = LLVMGetDefaultTargetTriple();
+	}
+	else {
+		LLVMInitializeAllTargetInfos();
+		LLVMInitializeAllTargets();
+		LLVMInitializeAllTargetMCs();
+		LLVMInitializeAllAsmPrinters();
+		triple = LLVMNormalizeTargetTriple(target->triple);
+	}
+
+	char *error = NULL;
+	LLVMTargetRef llvm_target;
+	if (LLVMGetTargetFromTriple(triple, &llvm_target, &error) != 0) {
+		fprintf(stderr, "Error: target %s: %s\n", triple, error);
+		LLVMDisposeMessage(error);
+		LLVMDisposeMessage(triple);
+		return NULL;
+	}
+
+	LLVMCodeGenOptLevel level;
+	switch (opt_level) {
+		case 0:
+			level = LLVMCodeGenLevelNone;
+			break;
+		case 1:
+			level = LLVMCodeGenLevelLess;
+			break;
+		case 2:
+			level = LLVMCodeGenLevelDefault;
+			break;
+		default:
+			level = LLVMCodeGenLevelAggressive;
+	}
+
+	// LLVM does not know "native", it is the host CPU with exactly the features it has
+	bool native = target->cpu != NULL && strcmp(target->cpu, EMIT_CPU_NATIVE) == 0;
+	char *host_cpu = native ? LLVMGetHostCPUName() : NULL;
+	char *host_features = native ? LLVMGetHostCPUFeatures() : NULL;
+	// an empty CPU is the target's baseline (what "generic" is for x86, RISC-V has no "generic")
+	const char *cpu = native ? host_cpu : target->cpu != NULL ? target->cpu : "";
+	char *features = join_features(host_features, target->features);
+
+	// position independent, executables are linked as PIE by default
+	LLVMTargetMachineRef machine = NULL;
+	if (features != NULL) {
+		machine = LLVMCreateTargetMachine(
+			llvm_target, triple, cpu, features, level, LLVMRelocPIC, LLVMCodeModelDefault
+		);
+	}
+	if (machine == NULL)
+		fprintf(stderr, "Error: could not create a target machine for %s\n", triple);
+
+	free(features);
+	if (native) {
+		LLVMDisposeMessage(host_cpu);
+		LLVMDisposeMessage(host_features);
+	}
+	LLVMDisposeMessage(triple);
+	return machine;
+}
+
+void emit_dispose_target_machine(LLVMTargetMachineRef machine) {
+	LLVMDisposeTargetMachine(machine);
+}
+
+void emit_set_target(LLVMModuleRef mod, LLVMTargetMachineRef machine) {
+	char *triple = LLVMGetTargetMachineTriple(machine);
+	LLVMSetTarget(mod, triple);
+	LLVMDisposeMessage(triple);
+
+	LLVMTargetDataRef data_layout = LLVMCreateTargetDataLayout(machine);
+	char *layout = LLVMCopyStringRepOfTargetData(data_layout);
+	LLVMSetDataLayout(mod, layout);
+	LLVMDisposeMessage(layout);
+	LLVMDisposeTargetData(data_layout);
+
+	char *cpu = LLVMGetTargetMachineCPU(machine);
+	char *features = LLVMGetTargetMachineFeatureString(machine);
+	for (LLVMValueRef func = LLVMGetFirstFunction(mod); func != NULL; func = LLVMGetNextFunction(func)) {
+		if (LLVMIsDeclaration(func))
+			continue;
+
+		if (cpu[0] != 0)
+			LLVMAddTargetDependentFunctionAttr(func, "target-cpu", cpu);
+		if (features[0] != 0)
+			LLVMAddTargetDependentFunctionAttr(func, "target-features", features);
+	}
+	LLVMDisposeMessage(cpu);
+	LLVMDisposeMessage(features);
+}
+
+bool emit_machine_code(
+	LLVMModuleRef mod,
+	LLVMTargetMachineRef machine,
+	LLVMCodeGenFileType type,
+	const char *path
+) {
+	char *error = NULL;
+	if (strcmp(path, CODEGEN_STDOUT) == 0) {
+		LLVMMemoryBufferRef buffer;
+		if (LLVMTargetMachineEmitToMemoryBuffer(machine, mod, type, &error, &buffer) != 0) {
+			fprintf(stderr, "Error: generating code: %s\n", error);
+			LLVMDisposeMessage(error);
+			return false;
+		}
+		bool ok = codegen_write_stdout(LLVMGetBufferStart(buffer), LLVMGetBufferSize(buffer));
+		LLVMDisposeMemoryBuffer(buffer);
+		return ok;
+	}
+
+	// the path is not modified, the C API just is not const correct
+	if (LLVMTargetMachineEmitToFile(machine, mod, (char *) path, type, &error) != 0) {
+		fprintf(stderr, "Error: writing %s: %s\n", path, error);
+		LLVMDisposeMessage(error);
+		return false;
+	}
+	return true;
+}
+
+// runs EMIT_LINKER objects... -o path, returns whether it exited with 0
+bool emit_link_executable(const char *const *objects, size_t num_objects, const char *path) {
+	char **argv = malloc((num_objects + 4) * sizeof(char *));
+	if (argv == NULL) {
+		fprintf(stderr, "Error: malloc failure\n");
+		return false;
+	}
+
+	// posix_spawn does not modify the arguments, they are only not const for historical reasons
+	size_t argc = 0;
+	argv[argc++] = EMIT_LINKER;
+	for (size_t i = 0; i < num_objects; i++)
+		argv[argc++] = (char *) objects[i];
+	argv[argc++] = "-o";
+	argv[argc++] = (char *) path;
+	argv[argc] = NULL;
+
+	pid_t pid;
+	int spawned = posix_spawnp(&pid, EMIT_LINKER, NULL, NULL, argv, environ);
+	free(argv);
+	if (spawned != 0) {
+		fprintf(stderr, "Error: could not run %s\n", EMIT_LINKER);
+		return false;
+	}
+
+	int status;
+	if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "Error: linking %s failed\n", path);
+		return false;
+	}
+	return true;
+}
+
+bool emit_executable(LLVMModuleRef mod, LLVMTargetMachineRef machine, const char *path) {
+	// no extension, the driver passes files it does not know straight to the linker
+	char object[] = "/tmp/jlang-XXXXXX";
+	int fd = mkstemp(object);
+	if (fd == -1) {
+		fprintf(stderr, "Error: could not create a temporary file\n");
+		return false;
+	}
+	close(fd);
+
+	const char *objects[] = { object };
+	bool ok = emit_machine_code(mod, machine, LLVMObjectFile, object) &&
+		emit_link_executable(objects, 1, path);
+	unlink(object);
+	return ok;
+}
@@ -1,12 +1,14 @@
 #include <llvm-c/Core.h>
 #include <llvm-c/Types.h>
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "codegen/expression.h"
 #include "codegen/function.h"
+#include "codegen/ssa.h"
 #include "utils/strmap.h"
 #include "ast.h"
 #include "lex.h"
@@ -21,33 +23,123 @@ LLVMValueRef codegen_number(
 	);
 }
 
+// every failed overflow check in the function branches here
+static struct ssa_block *get_trap_block(struct codegen_ctx *ctx) {
+	if (ctx->trap_block != NULL)
+		return ctx->trap_block;
+
+	LLVMValueRef func = LLVMGetBasicBlockParent(LLVMGetInsertBlock(ctx->build));
+	// sealed once the function is done (checks keep adding predecessors), see codegen()
+	ctx->trap_block = ssa_new_block(ctx->ssa, func, "overflowtrap");
+
+	// separate builder, the code builder stays where it is
+	LLVMBuilderRef build = LLVMCreateBuilderInContext(ctx->llvm_ctx);
+	LLVMPositionBuilderAtEnd(build, ssa_get_llvm_block(ctx->trap_block));
+
+	unsigned id = LLVMLookupIntrinsicID("llvm.trap", strlen("llvm.trap"));
+	LLVMBuildCall2(
+		build, LLVMIntrinsicGetType(ctx->llvm_ctx, id, NULL, 0),
+		LLVMGetIntrinsicDeclaration(ctx->module, id, NULL, 0), NULL, 0, ""
+	);
+	LLVMBuildUnreachable(build);
+	LLVMDisposeBuilder(build);
+
+	return ctx->trap_block;
+}
+
+// lhs op rhs through llvm.s{add,sub,mul}.with.overflow, code after it goes in a new block
+static LLVMValueRef build_checked(
+	struct codegen_ctx *ctx,
+	const char *intrinsic,
+	LLVMValueRef lhs,
+	LLVMValueRef rhs,
+	const char *name
+) {
+	LLVMTypeRef types[] = { LLVMInt32TypeInContext(ctx->llvm_ctx) };
+	unsigned id = LLVMLookupIntrinsicID(intrinsic, strlen(intrinsic));
+	LLVMValueRef args[] = { lhs, rhs };
+	LLVMValueRef result = LLVMBuildCall2(
+		ctx->build, LLVMIntrinsicGetType(ctx->llvm_ctx, id, types, 1),
+		LLVMGetIntrinsicDeclaration(ctx->module, id, types, 1), args, 2, "ovftmp"
+	);
+	LLVMValueRef overflow = LLVMBuildExtractValue(ctx->build, result, 1, "ovfbittmp");
+
+	struct ssa_block *trap_block = get_trap_block(ctx);
+	LLVMValueRef func = LLVMGetBasicBlockParent(LLVMGetInsertBlock(ctx->build));
+	struct ssa_block *cont_block = ssa_new_block(ctx->ssa, func, "ovfcont");
+	ssa_build_cond_br(ctx->ssa, ctx->build, overflow, trap_block, cont_block);
+	ssa_seal_block(ctx->ssa, cont_block);
+	ssa_position_at_end(ctx->ssa, ctx->build, cont_block);
+
+	return LLVMBuildExtractValue(ctx->build, result, 0, name);
+}
+
+// +, - and * follow ctx->overflow, see codegen/codegen.h
+static LLVMValueRef build_arith(
+	struct codegen_ctx *ctx,
+	enum lex_token_type op,
+	LLVMValueRef lhs,
+	LLVMValueRef rhs,
+	const char *name
+) {
+	switch (ctx->overflow) {
+		case CODEGEN_OVERFLOW_WRAP:
+			if (op == LEX_PLUS)
+				return LLVMBuildAdd(ctx->build, lhs, rhs, name);
+			if (op == LEX_MINUS)
+				return LLVMBuildSub(ctx->build, lhs, rhs, name);
+			return LLVMBuildMul(ctx->build, lhs, rhs, name);
+		case CODEGEN_OVERFLOW_UNDEFINED:
+			if (op == LEX_PLUS)
+				return LLVMBuildNSWAdd(ctx->build, lhs, rhs, name);
+			if (op == LEX_MINUS)
+				return LLVMBuildNSWSub(ctx->build, lhs, rhs, name);
+			return LLVMBuildNSWMul(ctx->build, lhs, rhs, name);
+		case CODEGEN_OVERFLOW_TRAP:
+			// constants are only checked at compile time (a negative literal is * -1)
+			if (LLVMIsAConstantInt(lhs) != NULL && LLVMIsAConstantInt(rhs) != NULL) {
+				int64_t a = LLVMConstIntGetSExtValue(lhs), b = LLVMConstIntGetSExtValue(rhs);
+				int64_t wide = op == LEX_PLUS ? a + b : op == LEX_MINUS ? a - b : a * b;
+				if (wide >= INT32_MIN && wide <= INT32_MAX)
+					return LLVMConstInt(LLVMInt32TypeInContext(ctx->llvm_ctx), wide, 1);
+			}
+			if (op == LEX_PLUS)
+				return build_checked(ctx, "llvm.sadd.with.overflow", lhs, rhs, name);
+			if (op == LEX_MINUS)
+				return build_checked(ctx, "llvm.ssub.with.overflow", lhs, rhs, name);
+			return build_checked(ctx, "llvm.smul.with.overflow", lhs, rhs, name);
+	}
+
+	fprintf(stderr, "ERROR! (26)\n");
+	exit(1);
+}
+
 LLVMValueRef codegen_factor(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
-	const struct strmap *var_map,
-	struct strmap *func_map
+	const struct strmap *var_map
 ) {
 	const struct ast_node *child = &node->value.children.l[0];
 
 	if (child->type == AST_EXPR)
-		return codegen_expression(build, child, var_map, func_map);
+		return codegen_expression(ctx, child, var_map);
 
 	if (child->type == AST_LEAF) {
 		if (child->value.token.type == LEX_NUMBER) {
 			return codegen_number(
-				LLVMGetBuilderContext(build),
+				ctx->llvm_ctx,
 				&child->value.token
 			);
 		}
 
 		if (child->value.token.type == LEX_IDENTIFIER) {
-			LLVMValueRef *value = strmap_get(var_map, child->value.token.str);
-			if (value != NULL)
-				return *value;
+			const char *name = child->value.token.str;
+			if (strmap_get(var_map, name) != NULL)
+				return ssa_read_variable(ctx->ssa, name, ssa_current_block(ctx->ssa));
 		}
 	}
 	else if (child->type == AST_FUNC_CALL) {
-		LLVMValueRef value = codegen_func_call(build, child, var_map, func_map);
+		LLVMValueRef value = codegen_func_call(ctx, child, var_map);
 		if (value != NULL)
 			return value;
 	}
@@ -57,10 +149,9 @@ LLVMValueRef codegen_factor(
 }
 
 LLVMValueRef codegen_term(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
-	const struct strmap *var_map,
-	struct strmap *func_map
+	const struct strmap *var_map
 ) {
 	if (node->type != AST_TERM) {
 		fprintf(stderr, "ERROR! (2)\n");
@@ -68,7 +159,7 @@ LLVMValueRef codegen_term(
 	}
 
 	const struct ast_node_list *list = &node->value.children;
-	LLVMValueRef lhs = codegen_factor(build, &list->l[0], var_map, func_map);
+	LLVMValueRef lhs = codegen_factor(ctx, &list->l[0], var_map);
 
 	size_t i;
 	for (i = 1; i < list->size - 1; i += 2) {
@@ -77,17 +168,17 @@ LLVMValueRef codegen_term(
 			exit(1);
 		}
 
-		LLVMValueRef rhs = codegen_factor(build, &list->l[i + 1], var_map, func_map);
+		LLVMValueRef rhs = codegen_factor(ctx, &list->l[i + 1], var_map);
 
 		switch (list->l[i].value.token.type) {
 			case LEX_STAR:
-				lhs = LLVMBuildMul(build, lhs, rhs, "multmp");
+				lhs = build_arith(ctx, LEX_STAR, lhs, rhs, "multmp");
 				break;
 			case LEX_SLASH:
-				lhs = LLVMBuildSDiv(build, lhs, rhs, "divtmp");
+				lhs = LLVMBuildSDiv(ctx->build, lhs, rhs, "divtmp");
 				break;
 			case LEX_PERCENT:
-				lhs = LLVMBuildSRem(build, lhs, rhs, "modtmp");
+				lhs = LLVMBuildSRem(ctx->build, lhs, rhs, "modtmp");
 				break;
 			default:
 				fprintf(stderr, "ERROR! (4)");
@@ -104,10 +195,9 @@ LLVMValueRef codegen_term(
 }
 
 LLVMValueRef codegen_expr_no_comp(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
-	const struct strmap *var_map,
-	struct strmap *func_map
+	const struct strmap *var_map
 ) {
 	if (node->type != AST_EXPR_NO_COMP) {
 		fprintf(stderr, "ERROR! (6)\n");
@@ -125,12 +215,12 @@ LLVMValueRef codegen_expr_no_comp(
 		i++;
 	}
 
-	LLVMValueRef lhs = codegen_term(build, &list->l[i], var_map, func_map);
+	LLVMValueRef lhs = codegen_term(ctx, &list->l[i], var_map);
 	if (first_is_negative) {
-		lhs = LLVMBuildMul(
-			build, lhs,
+		lhs = build_arith(
+			ctx, LEX_STAR, lhs,
 			LLVMConstInt(
-				LLVMInt32TypeInContext(LLVMGetBuilderContext(build)),
+				LLVMInt32TypeInContext(ctx->llvm_ctx),
 				-1, 0
 			),
 			"negtmp"
@@ -143,12 +233,12 @@ LLVMValueRef codegen_expr_no_comp(
 			exit(1);
 		}
 
-		LLVMValueRef rhs = codegen_term(build, &list->l[i + 1], var_map, func_map);
+		LLVMValueRef rhs = codegen_term(ctx, &list->l[i + 1], var_map);
 
 		if (list->l[i].value.token.type == LEX_PLUS)
-			lhs = LLVMBuildAdd(build, lhs, rhs, "addtmp");
+			lhs = build_arith(ctx, LEX_PLUS, lhs, rhs, "addtmp");
 		else if (list->l[i].value.token.type == LEX_MINUS)
-			lhs = LLVMBuildSub(build, lhs, rhs, "subtmp");
+			lhs = build_arith(ctx, LEX_MINUS, lhs, rhs, "subtmp");
 	}
 
 	if (i != list->size) {
@@ -159,11 +249,21 @@ LLVMValueRef codegen_expr_no_comp(
 	return lhs;
 }
 
-LLVMValueRef codegen_expression(
-	LLVMBuilderRef build,
+// the expression inside parentheses, if that is all node is: (expr)
+static const struct ast_node *parenthesized(const struct ast_node *node) {
+	for (int depth = 0; depth < 3; depth++) {
+		if (node->value.children.size != 1)
+			return NULL;
+		node = &node->value.children.l[0];
+	}
+	// expr_no_comp -> term -> factor -> expr
+	return node->type == AST_EXPR ? node : NULL;
+}
+
+struct codegen_value codegen_expression_value(
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
-	const struct strmap *var_map,
-	struct strmap *func_map
+	const struct strmap *var_map
 ) {
 	if (node->type != AST_EXPR) {
 		fprintf(stderr, "ERROR! (9)\n");
@@ -173,13 +273,21 @@ LLVMValueRef codegen_expression(
 	const struct ast_node_list *list = &node->value.children;
 
 	// not comparison, only child is expr_no_comp
-	if (list->size == 1)
-		return codegen_expr_no_comp(build, &list->l[0], var_map, func_map);
+	if (list->size == 1) {
+		const struct ast_node *inner = parenthesized(&list->l[0]);
+		if (inner != NULL)
+			return codegen_expression_value(ctx, inner, var_map);
+
+		return (struct codegen_value) {
+			.value = codegen_expr_no_comp(ctx, &list->l[0], var_map),
+			.kind = CODEGEN_VALUE_INT
+		};
+	}
 
 	if (list->size == 3) {
-		LLVMValueRef lhs = codegen_expr_no_comp(build, &list->l[0], var_map, func_map);
+		LLVMValueRef lhs = codegen_expr_no_comp(ctx, &list->l[0], var_map);
 		enum lex_token_type comp_type = list->l[1].value.token.type;
-		LLVMValueRef rhs = codegen_expr_no_comp(build, &list->l[2], var_map, func_map);
+		LLVMValueRef rhs = codegen_expr_no_comp(ctx, &list->l[2], var_map);
 
 		LLVMIntPredicate comp_pred;
 		switch (comp_type) {
@@ -206,15 +314,44 @@ LLVMValueRef codegen_expression(
 				exit(1);
 		}
 
-		LLVMValueRef bool_value = LLVMBuildICmp(build, comp_pred, lhs, rhs, "cmptmp");
-		return LLVMBuildIntCast2(
-			build, bool_value,
-			LLVMInt32TypeInContext(LLVMGetBuilderContext(build)),
-			false, "cmptmp2"
-		);
+		return (struct codegen_value) {
+			.value = LLVMBuildICmp(ctx->build, comp_pred, lhs, rhs, "cmptmp"),
+			.kind = CODEGEN_VALUE_BOOL
+		};
 	}
 
 	fprintf(stderr, "ERROR! (11)");
 	exit(1);
 }
 
+LLVMValueRef codegen_expression(
+	struct codegen_ctx *ctx,
+	const struct ast_node *node,
+	const struct strmap *var_map
+) {
+	struct codegen_value value = codegen_expression_value(ctx, node, var_map);
+	if (value.kind == CODEGEN_VALUE_INT)
+		return value.value;
+
+	return LLVMBuildZExt(
+		ctx->build, value.value,
+		LLVMInt32TypeInContext(ctx->llvm_ctx),
+		"cmptmp2"
+	);
+}
+
+LLVMValueRef codegen_condition(
+	struct codegen_ctx *ctx,
+	const struct ast_node *node,
+	const struct strmap *var_map
+) {
+	struct codegen_value value = codegen_expression_value(ctx, node, var_map);
+	if (value.kind == CODEGEN_VALUE_BOOL)
+		return value.value;
+
+	return LLVMBuildICmp(
+		ctx->build, LLVMIntNE, value.value,
+		LLVMConstInt(LLVMInt32TypeInContext(ctx->llvm_ctx), 0, 0),
+		"condtmp"
+	);
+}
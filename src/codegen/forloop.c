@@ -10,96 +10,105 @@
 #include "codegen/assignment.h"
 #include "codegen/expression.h"
 #include "codegen/statement.h"
-#include "utils/linkedlist.h"
+#include "codegen/debug.h"
+#include "codegen/ssa.h"
 #include "utils/strmap.h"
 #include "ast.h"
 
-struct break_cont_stmt {
-	struct strmap var_map;
-	LLVMBasicBlockRef block;
-};
-struct for_loop_context {
-	LLVMBasicBlockRef body_block;
-	LLVMBasicBlockRef cond_block;
-	LLVMBasicBlockRef after_phi_block;
-
-	struct strmap *loop_phi_nodes;
-	const struct ast_node *for_node;
-
-	struct ll_list_node *break_statements;
-	struct ll_list_node *continue_statements;
-};
-
-struct for_loop_context context;
-
 void codegen_continue(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
 	struct strmap *var_map
 ) {
-	// if body block is null then the context = {0} => called outside loop
-	if (context.body_block == NULL) {
+	(void) var_map;
+
+	if (ctx->loop == NULL) {
 		fprintf(stderr, "ERROR! continue/break outside loop\n");
 		exit(1);
 	}
 
-	struct break_cont_stmt *cur_continue = malloc(sizeof(struct break_cont_stmt));
-	cur_continue->var_map = strmap_copy(var_map);
-	cur_continue->block = LLVMAppendBasicBlockInContext(
-		LLVMGetBuilderContext(build),
-		LLVMGetBasicBlockParent(LLVMGetInsertBlock(build)),
-		"continueblock"
-	);
-
-	LLVMBuildBr(build, cur_continue->block);
-	LLVMPositionBuilderAtEnd(build, cur_continue->block);
+	STRMAP_STATS_ENTER(STRMAP_SITE_BREAK_CONT);
 
-	LLVMBuildBr(build, context.cond_block);
+	// the condition block is sealed after the body, values here become its phi operands
+	ssa_build_br(ctx->ssa, ctx->build, ctx->loop->cond_block);
 
-	ll_add(&context.continue_statements, cur_continue);
+	STRMAP_STATS_LEAVE();
 }
 
 void codegen_break(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
 	const struct strmap *var_map
 ) {
-	// if body block is null then the context = {0} => called outside loop
-	if (context.body_block == NULL) {
+	(void) var_map;
+
+	if (ctx->loop == NULL) {
 		fprintf(stderr, "ERROR! continue/break outside loop\n");
 		exit(1);
 	}
 
-	struct break_cont_stmt *cur_break = malloc(sizeof(struct break_cont_stmt));
-	cur_break->var_map = strmap_copy(var_map);
-	cur_break->block = LLVMAppendBasicBlockInContext(
-		LLVMGetBuilderContext(build),
-		LLVMGetBasicBlockParent(LLVMGetInsertBlock(build)),
-		"breakblock"
-	);
+	STRMAP_STATS_ENTER(STRMAP_SITE_BREAK_CONT);
 
-	LLVMBuildBr(build, cur_break->block);
-	LLVMPositionBuilderAtEnd(build, cur_break->block);
+	// the after block is sealed at the end of the loop
+	ssa_build_br(ctx->ssa, ctx->build, ctx->loop->after_block);
 
-	LLVMBuildBr(build, context.after_phi_block);
+	STRMAP_STATS_LEAVE();
+}
 
-	ll_add(&context.break_statements, cur_break);
+static LLVMValueRef codegen_end_condition(
+	struct codegen_ctx *ctx,
+	const struct ast_node *node,
+	const struct strmap *var_map
+) {
+	LLVMContextRef llvm_ctx = ctx->llvm_ctx;
+
+	// if the for loop condition is left blank, always true
+	if (node->value.children.l[1].value.children.size == 0)
+		return LLVMConstInt(LLVMInt1TypeInContext(llvm_ctx), 1, 0);
+
+	LLVMValueRef end_condition = codegen_condition(
+		ctx,
+		&node->value.children.l[1],
+		var_map
+	);
+	if (end_condition == NULL) {
+		fprintf(stderr, "ERROR! (21)\n");
+		exit(1);
+	}
+	return end_condition;
+}
+
+// a constant condition (see passes/fold.h) branches unconditionally
+static void build_loop_branch(
+	struct codegen_ctx *ctx,
+	LLVMValueRef condition,
+	struct ssa_block *body_block,
+	struct ssa_block *after_block
+) {
+	if (LLVMIsAConstantInt(condition) == NULL)
+		ssa_build_cond_br(ctx->ssa, ctx->build, condition, body_block, after_block);
+	else if (LLVMConstIntGetZExtValue(condition) != 0)
+		ssa_build_br(ctx->ssa, ctx->build, body_block);
+	else
+		ssa_build_br(ctx->ssa, ctx->build, after_block);
 }
 
+// lowered as
+//   before:  init; br cond ? forbody : forafterphi
+//   forbody: body; br forcond
+//   forcond: step; br cond ? forbody : forafterphi
+// forbody stays unsealed until the back edge from forcond exists, so variables read
+// in the body get (operandless) phis that are completed then, and removed if trivial
 void codegen_for_loop(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
-	struct strmap *var_map,
-	struct strmap *func_map
+	struct strmap *var_map
 ) {
-	LLVMContextRef llvm_ctx = LLVMGetBuilderContext(build);
-
-	// for nested loops, restore previous context
-	struct for_loop_context before_ctx = context;
+	// for nested loops, restore the enclosing loop afterwards
+	const struct codegen_loop *outer_loop = ctx->loop;
 
-	// adding the initial value both var_map and var_map_loop
-	// this is so that we can use a phi when setting the variable in the body of the loop
-	// this can be removed from the var_map at the end (if variable not declared/defined before)
+	STRMAP_STATS_ENTER(STRMAP_SITE_FOR);
 
 	// variable assigned in: for ([here]; ...; ...)
+	// it goes out of scope after the loop unless it was already defined
 	// currently only one variable, if we add support for multiple assignments (a = 0, b = 0, ...)
 	// this will have to become an array/list of char *'s
 
@@ -113,239 +122,91 @@ void codegen_for_loop(
 
 		loop_var_already_defined = strmap_get(var_map, loop_assign_var) != NULL;
 
-		codegen_assignment(build, &node->value.children.l[0], var_map, func_map);
+		codegen_assignment(ctx, &node->value.children.l[0], var_map);
 	}
 
+	// variables first assigned in the loop go out of scope after it
 	struct strmap var_map_loop = strmap_copy(var_map);
 
-	LLVMValueRef func = LLVMGetBasicBlockParent(LLVMGetInsertBlock(build));
-
-	// create references to block before for loop, for loop body, and after loop
-	LLVMBasicBlockRef before_block = LLVMGetInsertBlock(build);
-	LLVMBasicBlockRef body_block = LLVMAppendBasicBlockInContext(
-		llvm_ctx, func, "forbody"
-	);
-	LLVMBasicBlockRef cond_block = LLVMAppendBasicBlockInContext(
-		llvm_ctx, func, "forcond"
-	);
-	LLVMBasicBlockRef after_phi_block = LLVMAppendBasicBlockInContext(
-		llvm_ctx, func, "forafterphi"
-	);
-
-	context.break_statements = ll_new();
-	context.body_block = body_block;
-	context.cond_block = cond_block;
-	context.after_phi_block = after_phi_block;
-	context.for_node = node;
-
 	// evaluate end condition to decide whether to execute loop at all
-	// if the for loop condition is left blank, always true
-	LLVMValueRef end_condition;
-	if (node->value.children.l[1].value.children.size == 0)
-		end_condition = LLVMConstInt(LLVMInt1TypeInContext(llvm_ctx), 1, 0);
-	else {
-		end_condition = codegen_expression(
-			build,
-			&node->value.children.l[1],
-			&var_map_loop, func_map
-		);
-		if (end_condition == NULL) {
-			fprintf(stderr, "ERROR! (21)\n");
-			exit(1);
-		}
-		end_condition = LLVMBuildICmp(
-			build, LLVMIntNE, end_condition,
-			LLVMConstInt(LLVMInt32TypeInContext(llvm_ctx), 0, 0),
-			"forcmptmp"
-		);
-	}
 	// if satisfies condition, run loop
 	// otherwise, go to loop after immediately
-	LLVMBuildCondBr(build, end_condition, body_block, after_phi_block);
-
-	LLVMPositionBuilderAtEnd(build, body_block);
-
-	// create phi nodes for every variable
-	// value changes depending on whether we are just entering or
-	// if loop body has already executed previously
-	// make new string map to save phi nodes for each variable
-	// TODO: this doesn't have to be a hash table, a list of pairs is ok
-	struct strmap loop_phi_nodes = strmap_new();
-	for (uint64_t i = 0; i < var_map->bucket_count; i++) {
-		// linked list current node for var_map before loop (in "var_map" variable)
-		struct strmap_list_node *cur_before = var_map->list[i];
-		while (cur_before != NULL) {
-			LLVMValueRef phi = LLVMBuildPhi(
-				build,
-				LLVMInt32TypeInContext(llvm_ctx),
-				"forbodyphitmp"
-			);
-
-			// value before = value from before hte for loop
-			LLVMValueRef value_before = *(LLVMValueRef *) cur_before->value;
-
-			// if predecessor to current block is the before_block, this is the first iteration
-			// then need to use the value_before (this is how a phi node works)
-			LLVMAddIncoming(phi, &value_before, &before_block, 1);
-
-			// save phi node
-			// need separate map because the value in var_map_loop will be modified
-			strmap_set(&loop_phi_nodes, cur_before->str, &phi, sizeof(LLVMValueRef));
-			strmap_set(&var_map_loop, cur_before->str, &phi, sizeof(LLVMValueRef));
-
-			cur_before = cur_before->next;
-		}
+	// a condition known to be true on entry (see passes/fold.h) is not evaluated
+	LLVMValueRef end_condition;
+	if (node->flags & AST_FLAG_LOOP_ENTERS)
+		end_condition = LLVMConstInt(LLVMInt1TypeInContext(ctx->llvm_ctx), 1, 0);
+	else
+		end_condition = codegen_end_condition(ctx, node, &var_map_loop);
+
+	// constant false (see passes/fold.h): the body is never reached
+	if (LLVMIsAConstantInt(end_condition) != NULL && LLVMConstIntGetZExtValue(end_condition) == 0) {
+		if (loop_assign_var != NULL && !loop_var_already_defined)
+			strmap_remove(var_map, loop_assign_var, false);
+		strmap_free(&var_map_loop);
+		STRMAP_STATS_LEAVE();
+		return;
 	}
-	context.loop_phi_nodes = &loop_phi_nodes;
-
-	codegen_stmt_list(build, &node->value.children.l[3], &var_map_loop, func_map); 
 
-	LLVMBasicBlockRef main_loop_body_end_block = LLVMGetInsertBlock(build);
+	LLVMValueRef func = LLVMGetBasicBlockParent(LLVMGetInsertBlock(ctx->build));
 
-	// check loop condition to decide ...
-	LLVMBuildBr(build, cond_block);
-	LLVMPositionBuilderAtEnd(build, cond_block);
+	// blocks nothing would branch to are left out, see passes/reachability.h
+	bool once = node->flags & AST_FLAG_LOOP_ONCE;
+	bool terminates = node->flags & AST_FLAG_TERMINATES;
 
-	// phi nodes for condition block (predecessors: main loop body, continue statements)
-	for (uint64_t i = 0; i < var_map_loop.bucket_count; i++) {
-		struct strmap_list_node *cur_main_loop = var_map_loop.list[i];
-		while (cur_main_loop != NULL) {
-			LLVMValueRef value_main = *(LLVMValueRef *) strmap_get(&var_map_loop, cur_main_loop->str);
+	struct ssa_block *body_block = ssa_new_block(ctx->ssa, func, "forbody");
+	struct ssa_block *cond_block = once ? NULL : ssa_new_block(ctx->ssa, func, "forcond");
+	struct ssa_block *after_block = terminates ? NULL : ssa_new_block(ctx->ssa, func, "forafterphi");
 
-			LLVMValueRef phi = LLVMBuildPhi(
-				build,
-				LLVMInt32TypeInContext(llvm_ctx),
-				"forcondphitmp"
-			);
-			LLVMAddIncoming(phi, &value_main, &main_loop_body_end_block, 1);
+	struct codegen_loop loop = {
+		.body_block = body_block,
+		.cond_block = cond_block,
+		.after_block = after_block,
+		.for_node = node
+	};
+	ctx->loop = &loop;
 
-			struct ll_list_node *cur = context.continue_statements;
-			while (cur != NULL) {
-				struct break_cont_stmt *cur_continue = cur->data;
+	build_loop_branch(ctx, end_condition, body_block, after_block);
 
-				LLVMValueRef value_at_continue = *(LLVMValueRef *) strmap_get(
-					&cur_continue->var_map, cur_main_loop->str
-				);
-				LLVMAddIncoming(phi, &value_at_continue, &cur_continue->block, 1);
+	// without a back edge the entry is the only predecessor of the body
+	if (once)
+		ssa_seal_block(ctx->ssa, body_block);
 
-				cur = cur->next;
-			}
+	ssa_position_at_end(ctx->ssa, ctx->build, body_block);
+	bool terminated = codegen_stmt_list(ctx, &node->value.children.l[3], &var_map_loop);
+	if (!terminated)
+		ssa_build_br(ctx->ssa, ctx->build, cond_block);
 
-			strmap_set(&var_map_loop, cur_main_loop->str, &phi, sizeof(LLVMValueRef));
+	if (!once) {
+		// predecessors of the condition block: end of the body and continue statements
+		ssa_seal_block(ctx->ssa, cond_block);
+		ssa_position_at_end(ctx->ssa, ctx->build, cond_block);
+		// the step and condition belong to the loop's line, not the body's last
+		codegen_debug_location(ctx, node);
 
-			cur_main_loop = cur_main_loop->next;
-		}
-	}
+		if (node->value.children.l[2].value.children.size != 0)
+			codegen_assignment(ctx, &node->value.children.l[2], &var_map_loop);
 
-	if (node->value.children.l[2].value.children.size != 0)
-		codegen_assignment(build, &node->value.children.l[2], &var_map_loop, func_map);
+		// ... whether to execute again (branch to loop body block again)
+		// or to exit (branch to loop after block)
+		end_condition = codegen_end_condition(ctx, node, &var_map_loop);
+		build_loop_branch(ctx, end_condition, body_block, after_block);
 
-	if (node->value.children.l[1].value.children.size == 0)
-		end_condition = LLVMConstInt(LLVMInt1TypeInContext(llvm_ctx), 1, 0);
-	else {
-		end_condition = codegen_expression(
-			build,
-			&node->value.children.l[1],
-			&var_map_loop, func_map
-		);
-		if (end_condition == NULL) {
-			fprintf(stderr, "ERROR! (21)\n");
-			exit(1);
-		}
-		end_condition = LLVMBuildICmp(
-			build, LLVMIntNE, end_condition,
-			LLVMConstInt(LLVMInt32TypeInContext(llvm_ctx), 0, 0),
-			"forcmptmp"
-		);
-	}
-	// ... whether to execute again (branch to loop body block again)
-	// or to exit (branch to loop after block)
-	LLVMBasicBlockRef loop_block_end = LLVMGetInsertBlock(build);
-	LLVMBuildCondBr(build, end_condition, body_block, after_phi_block);
-
-	LLVMPositionBuilderAtEnd(build, after_phi_block);
-
-	// modify the original phi nodes created in the map earlier
-	// add an possible incoming block, which is from itself
-	// (if loop iterating again, the predecessor will be the loop_block)
-	// in this case, the value is what is currently stored in the loop_block_end
-	for (uint64_t i = 0; i < loop_phi_nodes.bucket_count; i++) {
-		struct strmap_list_node *cur_phi = loop_phi_nodes.list[i];
-		while (cur_phi != NULL) {
-			LLVMValueRef phi = *(LLVMValueRef *) cur_phi->value;
-			LLVMValueRef value_loop = *(LLVMValueRef *) strmap_get(&var_map_loop, cur_phi->str);
-			LLVMAddIncoming(phi, &value_loop, &loop_block_end, 1);
-			cur_phi = cur_phi->next;
-		}
+		// all edges into the body (entry, back edge) exist now
+		ssa_seal_block(ctx->ssa, body_block);
 	}
 
-	// iterate through ALREADY DEFINED variables and assign with phi nodes
-	// value depends on whether the loop iterated at all
-	for (uint64_t i = 0; i < var_map->bucket_count; i++) {
-		struct strmap_list_node *cur_before_loop = var_map->list[i];
-		while (cur_before_loop != NULL) {
-			LLVMValueRef value_before = *(LLVMValueRef *) cur_before_loop->value;
-			LLVMValueRef value_loop = *(LLVMValueRef *) strmap_get(&var_map_loop, cur_before_loop->str);
-
-			if (value_before == value_loop) {
-				cur_before_loop = cur_before_loop->next;
-				continue;
-			}
-
-			// if loop did not iterate at all, predecessor is the before_block
-			// if it did, it is the loop_block_end
-			LLVMValueRef phi = LLVMBuildPhi(
-				build,
-				LLVMInt32TypeInContext(llvm_ctx),
-				"forafterphitmp"
-			);
-			LLVMAddIncoming(phi, &value_before, &before_block, 1);
-			LLVMAddIncoming(phi, &value_loop, &loop_block_end, 1);
-
-			struct ll_list_node *cur = context.break_statements;
-			while (cur != NULL) {
-				struct break_cont_stmt *cur_break = cur->data;
-
-				LLVMValueRef value_at_break = *(LLVMValueRef *) strmap_get(
-					&cur_break->var_map, cur_before_loop->str
-				);
-				LLVMAddIncoming(phi, &value_at_break, &cur_break->block, 1);
-
-				cur = cur->next;
-			}
-
-			strmap_set(var_map, cur_before_loop->str, &phi, sizeof(LLVMValueRef));
-
-			cur_before_loop = cur_before_loop->next;
-		}
-	}
-
-	struct ll_list_node *cur;
-
-	cur = context.break_statements;
-	while (cur != NULL) {
-		struct break_cont_stmt *cur_break = cur->data;
-		strmap_free(&cur_break->var_map);
-		free(cur_break);
-		cur = cur->next;
-	}
-	cur = context.continue_statements;
-	while (cur != NULL) {
-		struct break_cont_stmt *cur_break = cur->data;
-		strmap_free(&cur_break->var_map);
-		free(cur_break);
-		cur = cur->next;
+	// all edges out of the loop (exit, breaks) exist now
+	if (!terminates) {
+		ssa_seal_block(ctx->ssa, after_block);
+		ssa_position_at_end(ctx->ssa, ctx->build, after_block);
 	}
 
 	if (loop_assign_var != NULL && !loop_var_already_defined)
 		strmap_remove(var_map, loop_assign_var, false);
 
 	strmap_free(&var_map_loop);
-	strmap_free(&loop_phi_nodes);
 
-	ll_free(&context.break_statements);
-	ll_free(&context.continue_statements);
+	ctx->loop = outer_loop;
 
-	context = before_ctx;
+	STRMAP_STATS_LEAVE();
 }
-
@@ -7,74 +7,150 @@
 #include <string.h>
 
 #include "codegen/function.h"
-#include "codegen/codegen.h"
 #include "codegen/expression.h"
 #include "utils/strmap.h"
+#include "utils/alloc.h"
 #include "ast.h"
 #include "lex.h"
 
-#define NUM_PARAMS(params) (sizeof(params) / sizeof(params[0]))
+#define BUILTIN_MAX_PARAMS 1
 
+// per module, only lives in that module's func_map
 struct function_info {
-	// if null, then not declared yet
+	// declaration in the current module
 	LLVMValueRef func;
 
 	LLVMTypeRef type;
 	bool is_builtin;
+	// signature, if builtin
+	const struct builtin_func *builtin;
 
 	// if not builtin, whether is defined
 	bool is_defined;
 };
 
-static void populate_builtin_funcs(
+enum builtin_type {
+	BUILTIN_VOID,
+	BUILTIN_I32
+};
+struct builtin_func {
+	const char *name;
+	enum builtin_type ret_type;
+	enum builtin_type param_types[BUILTIN_MAX_PARAMS];
+	unsigned num_params;
+};
+
+// builtin signatures, never modified so this is shared by every compile/thread
+// LLVM types belong to a context, so they are only created (per module) when a builtin is first called
+// these are the libc functions: int getchar(void), int putchar(int)
+static const struct builtin_func builtin_funcs[] = {
+	{ .name = "getchar", .ret_type = BUILTIN_I32, .num_params = 0 },
+	{ .name = "putchar", .ret_type = BUILTIN_I32, .param_types = { BUILTIN_I32 }, .num_params = 1 },
+};
+static const size_t BUILTIN_FUNCS_SIZE = sizeof(builtin_funcs) / sizeof(builtin_funcs[0]);
+
+static const struct builtin_func *find_builtin(const char *name) {
+	for (size_t i = 0; i < BUILTIN_FUNCS_SIZE; i++) {
+		if (strcmp(builtin_funcs[i].name, name) == 0)
+			return &builtin_funcs[i];
+	}
+	return NULL;
+}
+
+static LLVMTypeRef builtin_type_to_llvm(LLVMContextRef llvm_ctx, enum builtin_type type) {
+	switch (type) {
+		case BUILTIN_VOID:
+			return LLVMVoidTypeInContext(llvm_ctx);
+		case BUILTIN_I32:
+			return LLVMInt32TypeInContext(llvm_ctx);
+	}
+	return NULL;
+}
+
+void codegen_add_attribute(
 	LLVMContextRef llvm_ctx,
-	struct strmap *func_map
+	LLVMValueRef value,
+	LLVMAttributeIndex index,
+	const char *name
 ) {
-	struct function_info getchar_info = {
-		.func = NULL,
-		.type = LLVMFunctionType(LLVMInt8TypeInContext(llvm_ctx), NULL, 0, 0),
-		.is_builtin = true,
-		.is_defined = false
-	};
-	strmap_set(func_map, "getchar", &getchar_info, sizeof(getchar_info));
-
-	LLVMTypeRef putchar_params[] = { LLVMInt32TypeInContext(llvm_ctx) };
-	struct function_info putchar_info = {
-		.func = NULL,
-		.type = LLVMFunctionType(
-			LLVMVoidTypeInContext(llvm_ctx),
-			putchar_params,
-			NUM_PARAMS(putchar_params),
-			0
-		),
-		.is_builtin = true,
-		.is_defined = false
-	};
-	strmap_set(func_map, "putchar", &putchar_info, sizeof(putchar_info));
+	unsigned kind = LLVMGetEnumAttributeKindForName(name, strlen(name));
+	if (kind == 0) {
+		fprintf(stderr, "ERROR! unknown attribute %s\n", name);
+		exit(1);
+	}
+
+	LLVMAttributeRef attr = LLVMCreateEnumAttribute(llvm_ctx, kind, 0);
+	if (LLVMIsACallInst(value) != NULL)
+		LLVMAddCallSiteAttribute(value, index, attr);
+	else
+		LLVMAddAttributeAtIndex(value, index, attr);
 }
-void codegen_func_init(
+
+// the attributes LLVM itself infers for these libc functions (nothing is thrown, the
+// arguments and result are never undef), on the declaration and on every call so
+// they hold before (and without) LLVM's own inference
+// there are no memory attributes: stdio state and errno are memory the caller
+// could see if the module is linked with C, and jlang programs have no memory a
+// call could reach anyway (variables are registers or allocas that never escape)
+static void add_builtin_attributes(
 	LLVMContextRef llvm_ctx,
-	struct strmap *func_map
+	LLVMValueRef value,
+	const struct builtin_func *builtin
+) {
+	codegen_add_attribute(llvm_ctx, value, LLVMAttributeFunctionIndex, "nounwind");
+	if (builtin->ret_type != BUILTIN_VOID)
+		codegen_add_attribute(llvm_ctx, value, LLVMAttributeReturnIndex, "noundef");
+	for (unsigned i = 0; i < builtin->num_params; i++)
+		codegen_add_attribute(llvm_ctx, value, i + 1, "noundef");
+}
+
+// declare builtin in the context's module and cache it in its func_map
+// func_map belongs to the module being generated, so the cache is never shared
+static struct function_info *declare_builtin(
+	struct codegen_ctx *ctx,
+	const struct builtin_func *builtin
 ) {
-	populate_builtin_funcs(llvm_ctx, func_map);
+	LLVMContextRef llvm_ctx = ctx->llvm_ctx;
+
+	LLVMTypeRef param_types[BUILTIN_MAX_PARAMS];
+	for (unsigned i = 0; i < builtin->num_params; i++)
+		param_types[i] = builtin_type_to_llvm(llvm_ctx, builtin->param_types[i]);
+
+	LLVMTypeRef type = LLVMFunctionType(
+		builtin_type_to_llvm(llvm_ctx, builtin->ret_type),
+		param_types, builtin->num_params, 0
+	);
+
+	struct function_info info = {
+		.func = LLVMAddFunction(ctx->module, builtin->name, type),
+		.type = type,
+		.is_builtin = true,
+		.builtin = builtin,
+		.is_defined = false
+	};
+	add_builtin_attributes(llvm_ctx, info.func, builtin);
+	strmap_set(&ctx->func_map, builtin->name, &info, sizeof(info));
+
+	return strmap_get(&ctx->func_map, builtin->name);
 }
 
 LLVMValueRef codegen_func_call(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
-	const struct strmap *var_map,
-	struct strmap *func_map
+	const struct strmap *var_map
 ) {
 	(void) var_map;
 
-	LLVMContextRef llvm_ctx = LLVMGetBuilderContext(build);
-
 	const char *func_name = node->value.children.l[0].value.token.str;
-	struct function_info *func_info = strmap_get(func_map, func_name);
+	struct function_info *func_info = strmap_get(&ctx->func_map, func_name);
 
 	if (func_info == NULL) {
-		fprintf(stderr, "function %s not defined!\n", func_name);
-		exit(1);
+		const struct builtin_func *builtin = find_builtin(func_name);
+		if (builtin == NULL) {
+			fprintf(stderr, "function %s not defined!\n", func_name);
+			exit(1);
+		}
+		func_info = declare_builtin(ctx, builtin);
 	}
 
 	if (!func_info->is_builtin) {
@@ -83,12 +159,6 @@ LLVMValueRef codegen_func_call(
 		exit(1);
 	}
 
-	if (func_info->func == NULL) {
-		// this will modify the value in the map as well
-		LLVMModuleRef module = codegen_get_current_module();
-		func_info->func = LLVMAddFunction(module, func_name, func_info->type);
-	}
-		
 	struct ast_node_list *ast_params = &node->value.children.l[1].value.children;
 	size_t ast_param_num = ast_params->size;
 
@@ -97,27 +167,25 @@ LLVMValueRef codegen_func_call(
 		exit(1);
 	}
 
-	if (strcmp(func_name, "getchar") == 0) {
-		return LLVMBuildIntCast2(
-			build,
-			LLVMBuildCall2(build, func_info->type, func_info->func, NULL, 0, "getchartmp"),
-			LLVMInt32TypeInContext(llvm_ctx),
-			true,
-			"getcharcasttmp"
-		);
-	}
-
 	LLVMValueRef *params;
 	if (ast_param_num == 0)
 		params = NULL;
 	else {
-		params = malloc(ast_param_num * sizeof(LLVMValueRef));
+		params = alloc_malloc(ALLOC_CODEGEN, ast_param_num * sizeof(LLVMValueRef));
 		for (size_t i = 0; i < ast_param_num; i++)
-			params[i] = codegen_expression(build, &ast_params->l[i], var_map, func_map);
+			params[i] = codegen_expression(ctx, &ast_params->l[i], var_map);
 	}
 
-	LLVMValueRef out = LLVMBuildCall2(build, func_info->type, func_info->func, params, ast_param_num, "");
-	free(params);
+	// calls returning void can not be named
+	char name[64] = "";
+	if (func_info->builtin->ret_type != BUILTIN_VOID)
+		snprintf(name, sizeof(name), "%stmp", func_name);
+
+	LLVMValueRef out = LLVMBuildCall2(
+		ctx->build, func_info->type, func_info->func, params, ast_param_num, name
+	);
+	alloc_free(ALLOC_CODEGEN, params);
+	add_builtin_attributes(ctx->llvm_ctx, out, func_info->builtin);
 
 	return out;
 }
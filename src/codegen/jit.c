@@ -0,0 +1,83 @@
+#include <llvm-c/Core.h>
+#include <llvm-c/ExecutionEngine.h>
+#include <llvm-c/Target.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "codegen/jit.h"
+
+// host functions for the builtins (see codegen/function.c), by name
+// the parentheses keep libc's macro versions out
+static const struct {
+	const char *name;
+	void *address;
+} host_builtins[] = {
+	{ "getchar", (void *) (getchar) },
+	{ "putchar", (void *) (putchar) },
+};
+static const size_t HOST_BUILTINS_SIZE = sizeof(host_builtins) / sizeof(host_builtins[0]);
+
+bool jit_run_main(LLVMModuleRef mod, unsigned opt_level, unsigned perf, int *exit_code) {
+	LLVMLinkInMCJIT();
+	if (LLVMInitializeNativeTarget() != 0 || LLVMInitializeNativeAsmPrinter() != 0) {
+		fprintf(stderr, "Error: LLVM has no support for the host target\n");
+		return false;
+	}
+
+	struct LLVMMCJITCompilerOptions options;
+	LLVMInitializeMCJITCompilerOptions(&options, sizeof(options));
+	options.OptLevel = opt_level;
+
+	// the engine takes the module, it is given back before the engine is freed
+	LLVMExecutionEngineRef engine;
+	char *error = NULL;
+	if (LLVMCreateMCJITCompilerForModule(&engine, mod, &options, sizeof(options), &error) != 0) {
+		fprintf(stderr, "Error: could not create the JIT: %s\n", error);
+		LLVMDisposeMessage(error);
+		return false;
+	}
+
+	// the code is generated on the first address lookup, the listeners see it then
+	LLVMJITEventListenerRef listeners[2];
+	size_t num_listeners = 0;
+	if (perf & JIT_PERF_MAP)
+		listeners[num_listeners++] = jit_perf_map_listener();
+	if (perf & JIT_PERF_JITDUMP) {
+		// NULL if LLVM was built without perf support
+		LLVMJITEventListenerRef jitdump = LLVMCreatePerfJITEventListener();
+		if (jitdump != NULL)
+			listeners[num_listeners++] = jitdump;
+		else
+			fprintf(stderr, "Warning: LLVM was built without jitdump support\n");
+	}
+	for (size_t i = 0; i < num_listeners; i++)
+		jit_register_listener(engine, listeners[i]);
+
+	// only the builtins that are called are declared
+	for (size_t i = 0; i < HOST_BUILTINS_SIZE; i++) {
+		LLVMValueRef func = LLVMGetNamedFunction(mod, host_builtins[i].name);
+		if (func != NULL)
+			LLVMAddGlobalMapping(engine, func, host_builtins[i].address);
+	}
+
+	int (*main_func)(void) = (int (*)(void)) (uintptr_t) LLVMGetFunctionAddress(engine, "main");
+	if (main_func == NULL) {
+		fprintf(stderr, "ERROR! JIT has no main\n");
+		exit(1);
+	}
+	*exit_code = main_func();
+	// the program's output comes before anything jlang prints afterwards
+	fflush(stdout);
+
+	LLVMModuleRef removed;
+	if (LLVMRemoveModule(engine, mod, &removed, &error) != 0) {
+		fprintf(stderr, "ERROR! JIT remove module: %s\n", error);
+		exit(1);
+	}
+	for (size_t i = 0; i < num_listeners; i++)
+		jit_unregister_listener(engine, listeners[i]);
+	LLVMDisposeExecutionEngine(engine);
+	return true;
+}
@@ -0,0 +1,83 @@
+// MCJIT only takes event listeners through the C++ API
+
+#include <llvm-c/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/JITEventListener.h>
+#include <llvm/ExecutionEngine/RuntimeDyld.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Object/SymbolSize.h>
+#include <llvm/Support/Error.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <unistd.h>
+
+#include "codegen/jit.h"
+
+namespace {
+
+// appends "start size name" (hex) for every function in the loaded objects to
+// /tmp/perf-<pid>.map, where perf looks up symbols for code that has no file
+class perf_map_listener : public llvm::JITEventListener {
+	FILE *file = nullptr;
+
+public:
+	void notifyObjectLoaded(
+		ObjectKey key,
+		const llvm::object::ObjectFile &object,
+		const llvm::RuntimeDyld::LoadedObjectInfo &info
+	) override {
+		(void) key;
+
+		if (file == nullptr) {
+			char path[64];
+			snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int) getpid());
+			file = fopen(path, "a");
+			if (file == nullptr) {
+				fprintf(stderr, "Warning: cannot write %s\n", path);
+				return;
+			}
+		}
+
+		// the sections of this copy are at the addresses they were loaded at
+		llvm::object::OwningBinary<llvm::object::ObjectFile> loaded = info.getObjectForDebug(object);
+		if (loaded.getBinary() == nullptr)
+			return;
+
+		for (const auto &symbol_size : llvm::object::computeSymbolSizes(*loaded.getBinary())) {
+			const llvm::object::SymbolRef &symbol = symbol_size.first;
+			llvm::Expected<llvm::object::SymbolRef::Type> type = symbol.getType();
+			if (!type || *type != llvm::object::SymbolRef::ST_Function) {
+				llvm::consumeError(type.takeError());
+				continue;
+			}
+
+			llvm::Expected<llvm::StringRef> name = symbol.getName();
+			llvm::Expected<uint64_t> address = symbol.getAddress();
+			if (name && address && symbol_size.second != 0) {
+				fprintf(file, "%" PRIx64 " %" PRIx64 " %.*s\n", *address, symbol_size.second,
+					(int) name->size(), name->data());
+			}
+			llvm::consumeError(name.takeError());
+			llvm::consumeError(address.takeError());
+		}
+		// perf reads the map after the process is gone, but it may be killed before exit
+		fflush(file);
+	}
+};
+
+}
+
+LLVMJITEventListenerRef jit_perf_map_listener(void) {
+	// one for the process, like LLVM's own listeners
+	static perf_map_listener listener;
+	return llvm::wrap(static_cast<llvm::JITEventListener *>(&listener));
+}
+
+void jit_register_listener(LLVMExecutionEngineRef engine, LLVMJITEventListenerRef listener) {
+	llvm::unwrap(engine)->RegisterJITEventListener(llvm::unwrap(listener));
+}
+
+void jit_unregister_listener(LLVMExecutionEngineRef engine, LLVMJITEventListenerRef listener) {
+	llvm::unwrap(engine)->UnregisterJITEventListener(llvm::unwrap(listener));
+}
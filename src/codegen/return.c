@@ -10,10 +10,9 @@
 #include "ast.h"
 
 void codegen_return(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
-	struct strmap *var_map,
-	struct strmap *func_map
+	struct strmap *var_map
 ) {
 	if (node->type != AST_RETURN) {
 		fprintf(stderr, "ERROR! (14)\n");
@@ -27,7 +26,7 @@ void codegen_return(
 		exit(1);
 	}
 
-	LLVMValueRef value = codegen_expression(build, &list->l[0], var_map, func_map);
-	LLVMBuildRet(build, value);
+	LLVMValueRef value = codegen_expression(ctx, &list->l[0], var_map);
+	LLVMBuildRet(ctx->build, value);
 }
 
@@ -0,0 +1,412 @@
+#include <llvm-c/Core.h>
+#include <llvm-c/Types.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "codegen/ssa.h"
+#include "utils/linkedlist.h"
+#include "utils/strmap.h"
+#include "utils/alloc.h"
+
+struct ssa_incomplete_phi {
+	const char *name;
+	LLVMValueRef phi;
+};
+
+// open addressing hash map from values (never NULL) to values, for the removed phis and
+// as a set for the pending ones (a value mapped to itself)
+struct ssa_value_map {
+	struct ssa_value_map_entry {
+		LLVMValueRef key, value;
+	} *entries;
+	size_t size, capacity;
+};
+#define SSA_VALUE_MAP_MIN_CAPACITY 16
+
+struct ssa_block {
+	LLVMBasicBlockRef block;
+	bool sealed;
+
+	// current definition of each variable in this block (name -> LLVMValueRef)
+	struct strmap defs;
+	// phis created before the block was sealed, operands are added when sealing
+	struct ll_list_node *incomplete_phis;
+
+	struct ssa_block **preds;
+	size_t num_preds, preds_capacity;
+};
+
+struct ssa_builder {
+	LLVMContextRef llvm_ctx;
+	// phis and allocas get their own builder so the code builder keeps its position
+	LLVMBuilderRef insert_build;
+	// the builder code is generated with, loads/stores go there in memory mode
+	LLVMBuilderRef code_build;
+	struct ssa_block *current;
+
+	// memory mode: every variable is an alloca in the entry block (name -> LLVMValueRef)
+	bool memory_mode;
+	struct strmap allocas;
+
+	struct ll_list_node *blocks;
+	// trivial phis are unlinked from their block but only deleted in ssa_free,
+	// so that a phi removed during recursion can still be recognized (parent is NULL)
+	// removed phi -> what replaced it, the definition tables are updated when read
+	struct ssa_value_map removed_phis;
+	// phis that are still getting their operands, never removed as trivial until done
+	struct ssa_value_map pending_phis;
+	size_t phi_count;
+};
+
+static size_t value_map_slot(const struct ssa_value_map *map, LLVMValueRef key) {
+	// values are at least 8 byte aligned, the multiplier spreads the rest (Fibonacci hashing)
+	size_t slot = (size_t) (((uintptr_t) key >> 3) * UINT64_C(11400714819323198485));
+	slot &= map->capacity - 1;
+	while (map->entries[slot].key != NULL && map->entries[slot].key != key)
+		slot = (slot + 1) & (map->capacity - 1);
+	return slot;
+}
+
+static LLVMValueRef value_map_get(const struct ssa_value_map *map, LLVMValueRef key) {
+	if (map->capacity == 0)
+		return NULL;
+	const struct ssa_value_map_entry *entry = &map->entries[value_map_slot(map, key)];
+	return entry->key != NULL ? entry->value : NULL;
+}
+
+static void value_map_set(struct ssa_value_map *map, LLVMValueRef key, LLVMValueRef value) {
+	// at most half full
+	if ((map->size + 1) * 2 > map->capacity) {
+		struct ssa_value_map old = *map;
+		map->capacity = old.capacity == 0 ? SSA_VALUE_MAP_MIN_CAPACITY : old.capacity * 2;
+		map->entries = alloc_calloc(ALLOC_CODEGEN, map->capacity, sizeof(struct ssa_value_map_entry));
+		for (size_t i = 0; i < old.capacity; i++) {
+			if (old.entries[i].key != NULL)
+				map->entries[value_map_slot(map, old.entries[i].key)] = old.entries[i];
+		}
+		alloc_free(ALLOC_CODEGEN, old.entries);
+	}
+
+	struct ssa_value_map_entry *entry = &map->entries[value_map_slot(map, key)];
+	if (entry->key == NULL)
+		map->size++;
+	entry->key = key;
+	entry->value = value;
+}
+
+// linear probing: the entries after the removed one that would no longer be found
+// are moved back into the gap
+static void value_map_remove(struct ssa_value_map *map, LLVMValueRef key) {
+	if (map->capacity == 0)
+		return;
+	size_t gap = value_map_slot(map, key);
+	if (map->entries[gap].key == NULL)
+		return;
+	map->entries[gap].key = NULL;
+	map->size--;
+
+	size_t mask = map->capacity - 1;
+	for (size_t slot = (gap + 1) & mask; map->entries[slot].key != NULL; slot = (slot + 1) & mask) {
+		struct ssa_value_map_entry entry = map->entries[slot];
+		map->entries[slot].key = NULL;
+		map->entries[value_map_slot(map, entry.key)] = entry;
+	}
+}
+
+struct ssa_builder *ssa_new(LLVMContextRef llvm_ctx, bool memory) {
+	struct ssa_builder *ssa = alloc_malloc(ALLOC_CODEGEN, sizeof(struct ssa_builder));
+	ssa->llvm_ctx = llvm_ctx;
+	ssa->code_build = NULL;
+	ssa->current = NULL;
+	ssa->memory_mode = memory;
+	ssa->allocas = strmap_new();
+	ssa->blocks = ll_new();
+	ssa->removed_phis = (struct ssa_value_map) { NULL, 0, 0 };
+	ssa->pending_phis = (struct ssa_value_map) { NULL, 0, 0 };
+	ssa->phi_count = 0;
+	// last, nothing that can fail comes after it (see ssa_abandon)
+	ssa->insert_build = LLVMCreateBuilderInContext(llvm_ctx);
+	return ssa;
+}
+
+static void delete_removed_phis(struct ssa_builder *ssa) {
+	for (size_t i = 0; i < ssa->removed_phis.capacity; i++) {
+		if (ssa->removed_phis.entries[i].key != NULL)
+			LLVMDeleteInstruction(ssa->removed_phis.entries[i].key);
+	}
+}
+
+void ssa_abandon(struct ssa_builder *ssa) {
+	delete_removed_phis(ssa);
+	LLVMDisposeBuilder(ssa->insert_build);
+}
+
+void ssa_free(struct ssa_builder *ssa) {
+	struct ll_list_node *cur;
+
+	delete_removed_phis(ssa);
+
+	for (cur = ssa->blocks; cur != NULL; cur = cur->next) {
+		struct ssa_block *block = cur->data;
+		strmap_free(&block->defs);
+
+		struct ll_list_node *phi_node;
+		for (phi_node = block->incomplete_phis; phi_node != NULL; phi_node = phi_node->next)
+			alloc_free(ALLOC_CODEGEN, phi_node->data);
+		ll_free(&block->incomplete_phis);
+
+		alloc_free(ALLOC_CODEGEN, block->preds);
+		alloc_free(ALLOC_CODEGEN, block);
+	}
+
+	ll_free(&ssa->blocks);
+	alloc_free(ALLOC_CODEGEN, ssa->removed_phis.entries);
+	alloc_free(ALLOC_CODEGEN, ssa->pending_phis.entries);
+	strmap_free(&ssa->allocas);
+	LLVMDisposeBuilder(ssa->insert_build);
+	alloc_free(ALLOC_CODEGEN, ssa);
+}
+
+struct ssa_block *ssa_new_block(struct ssa_builder *ssa, LLVMValueRef func, const char *name) {
+	struct ssa_block *block = alloc_malloc(ALLOC_CODEGEN, sizeof(struct ssa_block));
+	block->block = LLVMAppendBasicBlockInContext(ssa->llvm_ctx, func, name);
+	block->sealed = false;
+	block->defs = strmap_new();
+	block->incomplete_phis = ll_new();
+	block->preds = NULL;
+	block->num_preds = 0, block->preds_capacity = 0;
+
+	ll_add(&ssa->blocks, block);
+	return block;
+}
+
+LLVMBasicBlockRef ssa_get_llvm_block(const struct ssa_block *block) {
+	return block->block;
+}
+
+void ssa_position_at_end(struct ssa_builder *ssa, LLVMBuilderRef build, struct ssa_block *block) {
+	LLVMPositionBuilderAtEnd(build, block->block);
+	ssa->code_build = build;
+	ssa->current = block;
+}
+
+struct ssa_block *ssa_current_block(const struct ssa_builder *ssa) {
+	return ssa->current;
+}
+
+static void add_pred(struct ssa_block *block, struct ssa_block *pred) {
+	if (block->sealed) {
+		fprintf(stderr, "ERROR! branch to sealed block\n");
+		exit(1);
+	}
+
+	if (block->num_preds == block->preds_capacity) {
+		block->preds_capacity = block->preds_capacity == 0 ? 2 : block->preds_capacity * 2;
+		block->preds = alloc_realloc(
+			ALLOC_CODEGEN, block->preds,
+			block->preds_capacity * sizeof(struct ssa_block *)
+		);
+	}
+	block->preds[block->num_preds++] = pred;
+}
+
+void ssa_build_br(struct ssa_builder *ssa, LLVMBuilderRef build, struct ssa_block *dest) {
+	LLVMBuildBr(build, dest->block);
+	add_pred(dest, ssa->current);
+}
+
+void ssa_build_cond_br(
+	struct ssa_builder *ssa,
+	LLVMBuilderRef build,
+	LLVMValueRef condition,
+	struct ssa_block *then_block,
+	struct ssa_block *else_block
+) {
+	LLVMBuildCondBr(build, condition, then_block->block, else_block->block);
+	add_pred(then_block, ssa->current);
+	add_pred(else_block, ssa->current);
+}
+
+// position insert_build at the start of a block, before anything already generated
+static void position_at_start(struct ssa_builder *ssa, LLVMBasicBlockRef block) {
+	LLVMValueRef first = LLVMGetFirstInstruction(block);
+	if (first == NULL)
+		LLVMPositionBuilderAtEnd(ssa->insert_build, block);
+	else
+		LLVMPositionBuilderBefore(ssa->insert_build, first);
+}
+
+static LLVMValueRef get_alloca(struct ssa_builder *ssa, const char *name, struct ssa_block *block) {
+	LLVMValueRef *value = strmap_get(&ssa->allocas, name);
+	if (value != NULL)
+		return *value;
+
+	position_at_start(ssa, LLVMGetEntryBasicBlock(LLVMGetBasicBlockParent(block->block)));
+	LLVMValueRef alloca = LLVMBuildAlloca(
+		ssa->insert_build, LLVMInt32TypeInContext(ssa->llvm_ctx), name
+	);
+	strmap_set(&ssa->allocas, name, &alloca, sizeof(LLVMValueRef));
+	return alloca;
+}
+
+void ssa_write_variable(
+	struct ssa_builder *ssa,
+	const char *name,
+	struct ssa_block *block,
+	LLVMValueRef value
+) {
+	if (ssa->memory_mode) {
+		LLVMBuildStore(ssa->code_build, value, get_alloca(ssa, name, block));
+		return;
+	}
+	strmap_set(&block->defs, name, &value, sizeof(LLVMValueRef));
+}
+
+// phis always go at the start of the block
+static LLVMValueRef new_phi(struct ssa_builder *ssa, struct ssa_block *block) {
+	position_at_start(ssa, block->block);
+
+	ssa->phi_count++;
+	return LLVMBuildPhi(ssa->insert_build, LLVMInt32TypeInContext(ssa->llvm_ctx), "phitmp");
+}
+
+static bool is_pending(const struct ssa_builder *ssa, LLVMValueRef phi) {
+	return value_map_get(&ssa->pending_phis, phi) != NULL;
+}
+
+// follow replacements of removed phis, a phi can be replaced by
+// another phi that is itself removed later
+// the IR is updated when a phi is removed (LLVMReplaceAllUsesWith), the definition
+// tables only when they are read, so removing a phi does not touch every block
+static LLVMValueRef resolve_removed(const struct ssa_builder *ssa, LLVMValueRef value) {
+	while (LLVMIsAPHINode(value) != NULL && LLVMGetInstructionParent(value) == NULL)
+		value = value_map_get(&ssa->removed_phis, value);
+	return value;
+}
+
+// a phi is trivial if it only merges itself and one other value
+// returns the value the phi has been replaced with (or the phi if not trivial)
+static LLVMValueRef try_remove_trivial_phi(struct ssa_builder *ssa, LLVMValueRef phi) {
+	LLVMValueRef same = NULL;
+	unsigned num_incoming = LLVMCountIncoming(phi);
+	for (unsigned i = 0; i < num_incoming; i++) {
+		LLVMValueRef op = LLVMGetIncomingValue(phi, i);
+		if (op == same || op == phi)
+			continue;
+		if (same != NULL)
+			return phi;
+		same = op;
+	}
+
+	// unreachable or no definition at all
+	if (same == NULL)
+		same = LLVMGetUndef(LLVMInt32TypeInContext(ssa->llvm_ctx));
+
+	// other phis using this one may become trivial once it is replaced
+	struct ll_list_node *users = ll_new();
+	for (LLVMUseRef use = LLVMGetFirstUse(phi); use != NULL; use = LLVMGetNextUse(use)) {
+		LLVMValueRef user = LLVMGetUser(use);
+		if (user != phi && LLVMIsAPHINode(user) != NULL)
+			ll_add(&users, user);
+	}
+
+	// recorded first, so a failed allocation (ssa_abandon) cannot leave it unlinked and unknown
+	value_map_set(&ssa->removed_phis, phi, same);
+	LLVMReplaceAllUsesWith(phi, same);
+	LLVMInstructionRemoveFromParent(phi);
+	ssa->phi_count--;
+
+	for (struct ll_list_node *cur = users; cur != NULL; cur = cur->next) {
+		LLVMValueRef user = cur->data;
+		if (LLVMGetInstructionParent(user) != NULL && !is_pending(ssa, user))
+			try_remove_trivial_phi(ssa, user);
+	}
+	ll_free(&users);
+
+	// same may have been one of the users and removed in turn
+	return resolve_removed(ssa, same);
+}
+
+static LLVMValueRef add_phi_operands(
+	struct ssa_builder *ssa,
+	const char *name,
+	LLVMValueRef phi,
+	struct ssa_block *block
+) {
+	value_map_set(&ssa->pending_phis, phi, phi);
+	for (size_t i = 0; i < block->num_preds; i++) {
+		struct ssa_block *pred = block->preds[i];
+		LLVMValueRef value = ssa_read_variable(ssa, name, pred);
+		LLVMAddIncoming(phi, &value, &pred->block, 1);
+	}
+	value_map_remove(&ssa->pending_phis, phi);
+
+	return try_remove_trivial_phi(ssa, phi);
+}
+
+static LLVMValueRef read_variable_recursive(
+	struct ssa_builder *ssa,
+	const char *name,
+	struct ssa_block *block
+) {
+	LLVMValueRef value;
+	if (!block->sealed) {
+		// predecessors not known yet, operands are filled in by ssa_seal_block
+		value = new_phi(ssa, block);
+
+		struct ssa_incomplete_phi *incomplete = alloc_malloc(
+			ALLOC_CODEGEN, sizeof(struct ssa_incomplete_phi)
+		);
+		incomplete->name = name;
+		incomplete->phi = value;
+		ll_add(&block->incomplete_phis, incomplete);
+	}
+	else if (block->num_preds == 0)
+		value = LLVMGetUndef(LLVMInt32TypeInContext(ssa->llvm_ctx));
+	else if (block->num_preds == 1)
+		value = ssa_read_variable(ssa, name, block->preds[0]);
+	else {
+		// write the phi first to break cycles through loops
+		LLVMValueRef phi = new_phi(ssa, block);
+		ssa_write_variable(ssa, name, block, phi);
+		value = add_phi_operands(ssa, name, phi, block);
+	}
+
+	ssa_write_variable(ssa, name, block, value);
+	return value;
+}
+
+LLVMValueRef ssa_read_variable(struct ssa_builder *ssa, const char *name, struct ssa_block *block) {
+	if (ssa->memory_mode) {
+		return LLVMBuildLoad2(
+			ssa->code_build, LLVMInt32TypeInContext(ssa->llvm_ctx),
+			get_alloca(ssa, name, block), "loadtmp"
+		);
+	}
+
+	LLVMValueRef *value = strmap_get(&block->defs, name);
+	if (value != NULL) {
+		*value = resolve_removed(ssa, *value);
+		return *value;
+	}
+	return read_variable_recursive(ssa, name, block);
+}
+
+void ssa_seal_block(struct ssa_builder *ssa, struct ssa_block *block) {
+	struct ll_list_node *cur;
+	for (cur = block->incomplete_phis; cur != NULL; cur = cur->next) {
+		struct ssa_incomplete_phi *incomplete = cur->data;
+		add_phi_operands(ssa, incomplete->name, incomplete->phi, block);
+		alloc_free(ALLOC_CODEGEN, incomplete);
+	}
+	ll_free(&block->incomplete_phis);
+
+	block->sealed = true;
+}
+
+size_t ssa_phi_count(const struct ssa_builder *ssa) {
+	return ssa->phi_count;
+}
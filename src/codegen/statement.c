@@ -12,45 +12,46 @@
 #include "codegen/forloop.h"
 #include "codegen/assignment.h"
 #include "codegen/conditional.h"
+#include "codegen/debug.h"
 #include "utils/strmap.h"
 #include "ast.h"
 
-// return whether to continue generating code
-// (after continue/break/return, stop generating so LLVM doesn't complain)
+// returns true if control does not continue after this statement
+// (return/break/continue, or an if/for flagged AST_FLAG_TERMINATES, see passes/reachability.h)
 bool codegen_statement(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
-	struct strmap *var_map,
-	struct strmap *func_map
+	struct strmap *var_map
 ) {
 	if (node->type != AST_STMT) {
 		fprintf(stderr, "ERROR! (16)\n");
 		exit(1);
 	}
 
+	codegen_debug_location(ctx, node);
+
 	const struct ast_node *child = &node->value.children.l[0];
 	switch (child->type) {
 		case AST_ASSIGN:
-			codegen_assignment(build, child, var_map, func_map);
+			codegen_assignment(ctx, child, var_map);
 			break;	
 		case AST_RETURN:
-			codegen_return(build, child, var_map, func_map);
-			break;
+			codegen_return(ctx, child, var_map);
+			return true;
 		case AST_FUNC_CALL:
-			codegen_func_call(build, child, var_map, func_map);
+			codegen_func_call(ctx, child, var_map);
 			break;
 		case AST_CONDITIONAL:
-			codegen_conditional(build, child, var_map, func_map);
-			break;
+			return codegen_conditional(ctx, child, var_map);
 		case AST_FOR:
-			codegen_for_loop(build, child, var_map, func_map);
-			break;
+			codegen_for_loop(ctx, child, var_map);
+			return (child->flags & AST_FLAG_TERMINATES) != 0;
 		// loops have custom handling for continue/break, do not use this function
 		case AST_CONTINUE:
-			codegen_continue(build, var_map);
+			codegen_continue(ctx, var_map);
 			return true;
 		case AST_BREAK:
-			codegen_break(build, var_map);
+			codegen_break(ctx, var_map);
 			return true;
 		default:
 			fprintf(stderr, "ERROR! (17)\n");
@@ -62,10 +63,9 @@ bool codegen_statement(
 
 // returns true if there is a terminator (continue/break/return) in this list
 bool codegen_stmt_list(
-	LLVMBuilderRef build,
+	struct codegen_ctx *ctx,
 	const struct ast_node *node,
-	struct strmap *var_map,
-	struct strmap *func_map
+	struct strmap *var_map
 ) {
 	if (node->type != AST_STMT_LIST) {
 		fprintf(stderr, "ERROR! (18)\n");
@@ -75,7 +75,7 @@ bool codegen_stmt_list(
 	const struct ast_node_list *list = &node->value.children;
 	for (size_t i = 0; i < list->size; i++) {
 		// if any is terminated, stop generating
-		if (codegen_statement(build, &list->l[i], var_map, func_map))
+		if (codegen_statement(ctx, &list->l[i], var_map))
 			return true;
 	}
 
@@ -0,0 +1,141 @@
+#include <llvm-c/Core.h>
+#include <llvm-c/TargetMachine.h>
+#include <llvm-c/lto.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "codegen/emit.h"
+#include "codegen/thinlto.h"
+
+// the whole file, NULL (after printing why) on failure
+static char *read_file(const char *path, size_t *size) {
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "Error: cannot read %s\n", path);
+		return NULL;
+	}
+
+	char *data = NULL;
+	long len;
+	if (fseek(file, 0, SEEK_END) == 0 && (len = ftell(file)) > 0 && fseek(file, 0, SEEK_SET) == 0) {
+		data = malloc(len);
+		if (data != NULL && fread(data, 1, len, file) != (size_t) len) {
+			free(data);
+			data = NULL;
+		}
+		*size = len;
+	}
+	fclose(file);
+
+	if (data == NULL)
+		fprintf(stderr, "Error: cannot read %s\n", path);
+	return data;
+}
+
+// libLTO aborts on modules without a summary, so they are turned away first
+static bool check_input(const char *path, const char *data, size_t size) {
+	lto_module_t module = lto_module_create_from_memory(data, size);
+	if (module == NULL) {
+		fprintf(stderr, "Error: %s: %s\n", path, lto_get_error_message());
+		return false;
+	}
+
+	bool thin = lto_module_is_thinlto(module);
+	lto_module_dispose(module);
+	if (!thin)
+		fprintf(stderr, "Error: %s has no ThinLTO summary (compile it with --thinlto)\n", path);
+	return thin;
+}
+
+// writes the objects to temporary files and links them, the files are removed again
+static bool link_objects(thinlto_code_gen_t codegen, const char *path) {
+	unsigned num_objects = thinlto_module_get_num_objects(codegen);
+	char **objects = calloc(num_objects, sizeof(char *));
+	if (objects == NULL) {
+		fprintf(stderr, "Error: malloc failure\n");
+		return false;
+	}
+
+	bool ok = true;
+	for (unsigned i = 0; ok && i < num_objects; i++) {
+		LTOObjectBuffer buffer = thinlto_module_get_object(codegen, i);
+		objects[i] = strdup("/tmp/jlang-XXXXXX");
+		int fd = objects[i] != NULL ? mkstemp(objects[i]) : -1;
+		if (fd == -1) {
+			fprintf(stderr, "Error: could not create a temporary file\n");
+			free(objects[i]);
+			objects[i] = NULL;
+			ok = false;
+			break;
+		}
+		ok = write(fd, buffer.Buffer, buffer.Size) == (ssize_t) buffer.Size;
+		ok = close(fd) == 0 && ok;
+		if (!ok)
+			fprintf(stderr, "Error: writing %s failed\n", objects[i]);
+	}
+
+	if (ok)
+		ok = emit_link_executable((const char *const *) objects, num_objects, path);
+
+	for (unsigned i = 0; i < num_objects; i++) {
+		if (objects[i] != NULL)
+			unlink(objects[i]);
+		free(objects[i]);
+	}
+	free(objects);
+	return ok;
+}
+
+bool thinlto_link(
+	const char *const *inputs,
+	size_t num_inputs,
+	const struct emit_target *target,
+	const char *path
+) {
+	// libLTO only keeps pointers to the buffers
+	char **data = calloc(num_inputs, sizeof(char *));
+	if (data == NULL) {
+		fprintf(stderr, "Error: malloc failure\n");
+		return false;
+	}
+
+	thinlto_code_gen_t codegen = thinlto_create_codegen();
+	// executables are linked as PIE by default
+	thinlto_codegen_set_pic_model(codegen, LTO_CODEGEN_PIC_MODEL_DYNAMIC);
+
+	char *host_cpu = NULL;
+	if (target->cpu != NULL && strcmp(target->cpu, EMIT_CPU_NATIVE) == 0) {
+		host_cpu = LLVMGetHostCPUName();
+		thinlto_codegen_set_cpu(codegen, host_cpu);
+	}
+	else if (target->cpu != NULL)
+		thinlto_codegen_set_cpu(codegen, target->cpu);
+
+	bool ok = true;
+	for (size_t i = 0; ok && i < num_inputs; i++) {
+		size_t size = 0;
+		data[i] = read_file(inputs[i], &size);
+		ok = data[i] != NULL && check_input(inputs[i], data[i], size);
+		if (ok)
+			thinlto_codegen_add_module(codegen, inputs[i], data[i], size);
+	}
+
+	if (ok) {
+		// everything else may be internalized (and dropped once it is inlined)
+		thinlto_codegen_add_must_preserve_symbol(codegen, "main", strlen("main"));
+		// one thread per module, as many as the machine has cores
+		thinlto_codegen_process(codegen);
+		ok = link_objects(codegen, path);
+	}
+
+	thinlto_codegen_dispose(codegen);
+	if (host_cpu != NULL)
+		LLVMDisposeMessage(host_cpu);
+	for (size_t i = 0; i < num_inputs; i++)
+		free(data[i]);
+	free(data);
+	return ok;
+}
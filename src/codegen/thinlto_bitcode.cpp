@@ -0,0 +1,40 @@
+// the summary writer is only in the C++ API
+
+#include <llvm/Analysis/ModuleSummaryAnalysis.h>
+#include <llvm/Analysis/ProfileSummaryInfo.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/ModuleSummaryIndex.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cstdio>
+#include <system_error>
+
+#include "codegen/thinlto.h"
+
+bool thinlto_write_bitcode(LLVMModuleRef mod, const char *path) {
+	const llvm::Module &module = *llvm::unwrap(mod);
+
+	// what opt --thinlto-bc writes for modules without type metadata
+	// (no block frequencies, there is no profile data)
+	llvm::ProfileSummaryInfo profile(module);
+	llvm::ModuleSummaryIndex index = llvm::buildModuleSummaryIndex(module, nullptr, &profile);
+
+	// "-" is stdout for raw_fd_ostream too
+	std::error_code error;
+	llvm::raw_fd_ostream out(path, error);
+	if (error) {
+		fprintf(stderr, "Error: writing %s: %s\n", path, error.message().c_str());
+		return false;
+	}
+
+	// the hash identifies the module in ThinLTO caches
+	llvm::WriteBitcodeToFile(module, out, false, &index, true);
+	out.close();
+	if (out.has_error()) {
+		fprintf(stderr, "Error: writing %s: %s\n", path, out.error().message().c_str());
+		out.clear_error();
+		return false;
+	}
+	return true;
+}
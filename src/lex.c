@@ -4,6 +4,7 @@
 #include <errno.h>
 
 #include "lex.h"
+#include "utils/alloc.h"
 
 static inline size_t min(size_t a, size_t b) {
 	return a < b ? a : b;
@@ -23,7 +24,7 @@ struct lex_token lex_new_token(enum lex_token_type type, const char *str, int li
 	};
 }
 void lex_free_token(struct lex_token *token) {
-	free((void *) token->str);
+	alloc_free(ALLOC_LEX, (void *) token->str);
 }
 
 // true if successful, false if not
@@ -218,7 +219,7 @@ struct lex_token_list lex_new_token_list(void) {
 void token_list_append(struct lex_token_list *list, struct lex_token token) {
 	if (list->capacity == 0) {
 		list->capacity = 1, list->size = 1;
-		list->l = malloc(1 * sizeof(struct lex_token));
+		list->l = alloc_malloc(ALLOC_LEX, 1 * sizeof(struct lex_token));
 		list->l[0] = token;
 		return;
 	}
@@ -228,13 +229,13 @@ void token_list_append(struct lex_token_list *list, struct lex_token token) {
 	}
 
 	list->capacity *= 2;
-	list->l = realloc(list->l, list->capacity * sizeof(struct lex_token));
+	list->l = alloc_realloc(ALLOC_LEX, list->l, list->capacity * sizeof(struct lex_token));
 	list->l[list->size++] = token;
 }
 void lex_free_token_list(struct lex_token_list *list) {
 	for (size_t i = 0; i < list->size; i++)
 		lex_free_token(&list->l[i]);
-	free(list->l);
+	alloc_free(ALLOC_LEX, list->l);
 	list->capacity = 0, list->size = 0;
 }
 
@@ -242,18 +243,18 @@ static const char *scan_line(int line_num, struct lex_token_list *token_list, co
 	size_t start = 0;
 	for (size_t i = 0; i < line_len; i++) {
 		for (size_t j = min(max_delim_len, line_len - i); j >= 1; j--) {
-			char *delim = malloc((j + 1) * sizeof(char));
+			char *delim = alloc_malloc(ALLOC_LEX, (j + 1) * sizeof(char));
 			strncpy(delim, line + i, j);
 			delim[j] = 0;
 
 			enum lex_token_type delim_found = str_to_delim(delim);
 			if ((int) delim_found == -1) {
-				free(delim);
+				alloc_free(ALLOC_LEX, delim);
 				continue;
 			}
 
 			if (start != i) {
-				char *prev_token = malloc((i - start + 1) * sizeof(char));
+				char *prev_token = alloc_malloc(ALLOC_LEX, (i - start + 1) * sizeof(char));
 				strncpy(prev_token, line + start, i - start);
 				prev_token[i - start] = 0;
 
@@ -266,7 +267,7 @@ static const char *scan_line(int line_num, struct lex_token_list *token_list, co
 			if (delim_found != LEX_NOTHING)
 				token_list_append(token_list, lex_new_token(delim_found, delim, line_num));
 			else
-				free(delim);
+				alloc_free(ALLOC_LEX, delim);
 
 			start = i + j;
 			i += j - 1;
@@ -1,13 +1,27 @@
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
+#include <setjmp.h>
+#include <unistd.h>
 
 #include "lex.h"
 #include "ast.h"
 #include "parse.h"
 #include "codegen/codegen.h"
+#include "codegen/emit.h"
+#include "codegen/jit.h"
+#include "codegen/thinlto.h"
+#include "passes/fold.h"
+#include "passes/liveness.h"
+#include "passes/reachability.h"
+#include "utils/alloc.h"
+#include "utils/cache.h"
+#include "utils/memreport.h"
+#include "utils/timereport.h"
 
 size_t count_lines(FILE *file) {
 	size_t lines = 0;
@@ -46,13 +60,646 @@ char *get_module_name(const char *filename) {
 	return module_name;
 }
 
+// returns <name><extension>, NULL on malloc failure
+char *with_extension(const char *name, const char *extension) {
+	char *path = malloc((strlen(name) + strlen(extension) + 1) * sizeof(char));
+	if (path == NULL)
+		return NULL;
+
+	strcpy(path, name);
+	strcat(path, extension);
+	return path;
+}
+
+enum mem_report_mode {
+	MEM_REPORT_NONE,
+	MEM_REPORT_TEXT,
+	MEM_REPORT_JSON
+};
+// what can be written (--emit=bc,ll,...), all from one module, in this order:
+// bitcode and IR come first, generating machine code changes the module
+enum emit_kind {
+	EMIT_BC,
+	EMIT_LL,
+	EMIT_ASM,
+	EMIT_OBJ,
+	EMIT_EXE,
+	EMIT_KINDS
+};
+static const char *const emit_names[EMIT_KINDS] = { "bc", "ll", "asm", "obj", "exe" };
+static const char *const emit_extensions[EMIT_KINDS] = { ".bc", ".ll", ".s", ".o", "" };
+static const char *const emit_phases[EMIT_KINDS] = {
+	"write_bitcode", "write_ir", "emit_asm", "emit_object", "emit_executable"
+};
+// kinds that need a target machine
+#define EMIT_NATIVE ((1u << EMIT_ASM) | (1u << EMIT_OBJ) | (1u << EMIT_EXE))
+
+static unsigned count_emit_kinds(unsigned emit) {
+	unsigned count = 0;
+	for (enum emit_kind kind = 0; kind < EMIT_KINDS; kind++)
+		count += (emit >> kind) & 1;
+	return count;
+}
+
+// comma separated kinds into emit (1 << kind for each)
+// returns false (after printing why) if one is unknown
+static bool parse_emit_kinds(const char *list, unsigned *emit) {
+	*emit = 0;
+	while (true) {
+		size_t len = strcspn(list, ",");
+		enum emit_kind kind = 0;
+		while (kind < EMIT_KINDS && !(strlen(emit_names[kind]) == len &&
+				strncmp(list, emit_names[kind], len) == 0))
+			kind++;
+		if (kind == EMIT_KINDS) {
+			fprintf(stderr, "Error: unknown output kind %.*s\n", (int) len, list);
+			return false;
+		}
+		*emit |= 1u << kind;
+
+		if (list[len] == 0)
+			return true;
+		list += len + 1;
+	}
+}
+struct options {
+	// every input, exactly one (the source file) unless linking with --thinlto-link
+	const char *const *inputs;
+	size_t num_inputs;
+	const char *filename;
+	enum mem_report_mode mem_report;
+	bool time_report;
+	struct codegen_options codegen;
+	// pipeline for -O1 and up (NULL for -O0), --passes replaces it
+	const char *opt_pipeline;
+	const char *passes;
+	// 0 to 3, for the target machine (-Os is 2)
+	unsigned opt_level;
+	struct emit_target target;
+	// 1 << kind for each enum emit_kind written
+	unsigned emit;
+	// NULL for <file> with each kind's extension (<file>.bc, <file>.o, ...)
+	// with one kind the path itself (CODEGEN_STDOUT for stdout), with more
+	// the name the extensions are added to
+	const char *output;
+	// nothing is written, the program is JIT compiled and run in process
+	bool run;
+	// with --run, what perf is told about the JIT's code (enum jit_perf mask)
+	unsigned jit_perf;
+	// bitcode with a module summary, optimized with the ThinLTO pre-link pipeline
+	bool thinlto;
+	// the inputs are bitcode written with --thinlto, linked into an executable
+	bool thinlto_link;
+	// --cache, cache_dir NULL for the default directory (utils/cache.h)
+	bool cache;
+	const char *cache_dir;
+	uint64_t cache_max_bytes;
+	// --mem-limit, 0 for none: the front end allocates from a pool of at most this many bytes
+	size_t mem_limit;
+};
+
+// -O pipelines and their ThinLTO versions, which leave what pays off after
+// importing (e.g. most inlining and unrolling) to the link
+static const char *const thinlto_pipelines[][2] = {
+	{ "default<O1>", "thinlto-pre-link<O1>" },
+	{ "default<O2>", "thinlto-pre-link<O2>" },
+	{ "default<O3>", "thinlto-pre-link<O3>" },
+	{ "default<Os>", "thinlto-pre-link<Os>" },
+};
+
+// returns false (after printing why) if the arguments are invalid
+// the inputs are moved to the front of argv (after argv[0]), like getopt does
+bool parse_args(int argc, const char *argv[], struct options *opts) {
+	opts->inputs = argv + 1;
+	opts->num_inputs = 0;
+	opts->filename = NULL;
+	opts->mem_report = MEM_REPORT_NONE;
+	opts->time_report = false;
+	opts->codegen.lowering = CODEGEN_LOWERING_AUTO;
+	opts->codegen.overflow = CODEGEN_OVERFLOW_WRAP;
+	opts->codegen.discard_names = false;
+	opts->codegen.verify = true;
+	opts->codegen.debug_file = NULL;
+	bool debug = false;
+	// --verify turns the verifier back on after --fast-compile, in either order
+	bool verify_given = false;
+	// -O0 leaves no pipeline, --thinlto-link rejects any -O
+	bool opt_given = false;
+	opts->opt_pipeline = NULL;
+	opts->passes = NULL;
+	opts->opt_level = 0;
+	opts->target.triple = NULL;
+	opts->target.cpu = NULL;
+	opts->target.features = NULL;
+	opts->emit = 1u << EMIT_BC;
+	opts->output = NULL;
+	opts->run = false;
+	opts->jit_perf = 0;
+	opts->thinlto = false;
+	opts->thinlto_link = false;
+	opts->cache = false;
+	opts->cache_dir = NULL;
+	opts->cache_max_bytes = CACHE_DEFAULT_MAX_BYTES;
+	opts->mem_limit = 0;
+	// -o without --emit links an executable (unless it is stdout)
+	bool emit_given = false;
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		if (strcmp(arg, "--mem-report") == 0 || strcmp(arg, "--mem-report=text") == 0)
+			opts->mem_report = MEM_REPORT_TEXT;
+		else if (strcmp(arg, "--mem-report=json") == 0)
+			opts->mem_report = MEM_REPORT_JSON;
+		else if (strcmp(arg, "--time-report") == 0)
+			opts->time_report = true;
+		else if (strcmp(arg, "-g") == 0)
+			debug = true;
+		else if (strcmp(arg, "--lowering=auto") == 0)
+			opts->codegen.lowering = CODEGEN_LOWERING_AUTO;
+		else if (strcmp(arg, "--lowering=ssa") == 0)
+			opts->codegen.lowering = CODEGEN_LOWERING_SSA;
+		else if (strcmp(arg, "--lowering=memory") == 0)
+			opts->codegen.lowering = CODEGEN_LOWERING_MEMORY;
+		else if (strcmp(arg, "--overflow=wrap") == 0)
+			opts->codegen.overflow = CODEGEN_OVERFLOW_WRAP;
+		else if (strcmp(arg, "--overflow=undefined") == 0)
+			opts->codegen.overflow = CODEGEN_OVERFLOW_UNDEFINED;
+		else if (strcmp(arg, "--overflow=trap") == 0)
+			opts->codegen.overflow = CODEGEN_OVERFLOW_TRAP;
+		else if (strcmp(arg, "--fast-compile") == 0) {
+			opts->codegen.discard_names = true;
+			opts->codegen.verify = false;
+		}
+		else if (strcmp(arg, "--verify") == 0)
+			verify_given = true;
+		else if (strcmp(arg, "-O0") == 0) {
+			opt_given = true;
+			opts->opt_pipeline = NULL;
+			opts->opt_level = 0;
+		}
+		else if (strcmp(arg, "-O1") == 0) {
+			opt_given = true;
+			opts->opt_pipeline = "default<O1>";
+			opts->opt_level = 1;
+		}
+		else if (strcmp(arg, "-O2") == 0) {
+			opt_given = true;
+			opts->opt_pipeline = "default<O2>";
+			opts->opt_level = 2;
+		}
+		else if (strcmp(arg, "-O3") == 0) {
+			opt_given = true;
+			opts->opt_pipeline = "default<O3>";
+			opts->opt_level = 3;
+		}
+		else if (strcmp(arg, "-Os") == 0) {
+			opt_given = true;
+			opts->opt_pipeline = "default<Os>";
+			opts->opt_level = 2;
+		}
+		else if (strncmp(arg, "--passes=", strlen("--passes=")) == 0)
+			opts->passes = arg + strlen("--passes=");
+		else if (strncmp(arg, "--emit=", strlen("--emit=")) == 0) {
+			if (!parse_emit_kinds(arg + strlen("--emit="), &opts->emit))
+				return false;
+			emit_given = true;
+		}
+		else if (strncmp(arg, "--target=", strlen("--target=")) == 0)
+			opts->target.triple = arg + strlen("--target=");
+		else if (strncmp(arg, "--mcpu=", strlen("--mcpu=")) == 0)
+			opts->target.cpu = arg + strlen("--mcpu=");
+		else if (strncmp(arg, "--mattr=", strlen("--mattr=")) == 0)
+			opts->target.features = arg + strlen("--mattr=");
+		else if (strcmp(arg, "--thinlto") == 0)
+			opts->thinlto = true;
+		else if (strcmp(arg, "--thinlto-link") == 0)
+			opts->thinlto_link = true;
+		else if (strcmp(arg, "--run") == 0)
+			opts->run = true;
+		else if (strcmp(arg, "--perf-map") == 0)
+			opts->jit_perf |= JIT_PERF_MAP;
+		else if (strcmp(arg, "--jitdump") == 0)
+			opts->jit_perf |= JIT_PERF_JITDUMP;
+		else if (strcmp(arg, "--cache") == 0)
+			opts->cache = true;
+		else if (strncmp(arg, "--cache-dir=", strlen("--cache-dir=")) == 0) {
+			opts->cache = true;
+			opts->cache_dir = arg + strlen("--cache-dir=");
+			if (opts->cache_dir[0] == 0) {
+				fprintf(stderr, "Error: --cache-dir needs a directory\n");
+				return false;
+			}
+		}
+		else if (strncmp(arg, "--cache-size=", strlen("--cache-size=")) == 0) {
+			// in MiB
+			const char *size = arg + strlen("--cache-size=");
+			char *end;
+			errno = 0;
+			unsigned long long mib = strtoull(size, &end, 10);
+			if (size[0] == 0 || *end != 0 || errno != 0 || mib > UINT64_MAX / (1024 * 1024)) {
+				fprintf(stderr, "Error: invalid cache size %s\n", size);
+				return false;
+			}
+			opts->cache_max_bytes = mib * 1024 * 1024;
+		}
+		else if (strncmp(arg, "--mem-limit=", strlen("--mem-limit=")) == 0) {
+			// in MiB
+			const char *size = arg + strlen("--mem-limit=");
+			char *end;
+			errno = 0;
+			unsigned long long mib = strtoull(size, &end, 10);
+			if (size[0] == 0 || *end != 0 || errno != 0 || mib == 0 || mib > SIZE_MAX / (1024 * 1024)) {
+				fprintf(stderr, "Error: invalid memory limit %s\n", size);
+				return false;
+			}
+			opts->mem_limit = mib * 1024 * 1024;
+		}
+		else if (strcmp(arg, "-o") == 0) {
+			if (i + 1 == argc) {
+				fprintf(stderr, "Error: -o needs a file name\n");
+				return false;
+			}
+			opts->output = argv[++i];
+		}
+		else if (arg[0] == '-') {
+			fprintf(stderr, "Error: unknown option %s\n", arg);
+			return false;
+		}
+		else
+			argv[1 + opts->num_inputs++] = arg;
+	}
+
+	if (opts->thinlto_link) {
+		if (opts->num_inputs == 0) {
+			fprintf(stderr, "Error: need the bitcode files to link\n");
+			return false;
+		}
+		if (emit_given || opts->run || opts->thinlto) {
+			fprintf(stderr, "Error: --thinlto-link links an executable, it takes no other output options\n");
+			return false;
+		}
+		if (opts->output != NULL && strcmp(opts->output, CODEGEN_STDOUT) == 0) {
+			fprintf(stderr, "Error: an executable cannot be written to stdout\n");
+			return false;
+		}
+		// the modules were compiled (and optimized) with their own options, the target triple
+		// comes from them, and libLTO only takes a CPU
+		if (opts->target.triple != NULL || opts->target.features != NULL || opt_given ||
+			opts->passes != NULL || debug || opts->codegen.lowering != CODEGEN_LOWERING_AUTO ||
+			opts->codegen.overflow != CODEGEN_OVERFLOW_WRAP || opts->codegen.discard_names ||
+			verify_given || opts->jit_perf != 0 || opts->cache || opts->cache_dir != NULL ||
+			opts->cache_max_bytes != CACHE_DEFAULT_MAX_BYTES || opts->mem_limit != 0) {
+			fprintf(stderr, "Error: --thinlto-link only takes -o, --mcpu and the reports, the other options are for compiling the modules\n");
+			return false;
+		}
+		return true;
+	}
+
+	if (opts->num_inputs != 1) {
+		fprintf(stderr, "Error: need exactly one input file\n");
+		return false;
+	}
+	opts->filename = opts->inputs[0];
+	if (debug)
+		opts->codegen.debug_file = opts->filename;
+
+	if (verify_given)
+		opts->codegen.verify = true;
+	// -o - streams bitcode
+	bool to_stdout = opts->output != NULL && strcmp(opts->output, CODEGEN_STDOUT) == 0;
+	if (opts->output != NULL && !to_stdout && !emit_given)
+		opts->emit = 1u << EMIT_EXE;
+	if (opts->run && (opts->output != NULL || emit_given)) {
+		fprintf(stderr, "Error: --run writes no output, -o and --emit cannot be used with it\n");
+		return false;
+	}
+	if (!opts->run && opts->jit_perf != 0) {
+		fprintf(stderr, "Error: --perf-map and --jitdump are for code run with --run\n");
+		return false;
+	}
+	if (opts->run && opts->target.triple != NULL) {
+		fprintf(stderr, "Error: --run runs on the host, --target cannot be used with it\n");
+		return false;
+	}
+	if (opts->thinlto) {
+		if (opts->run || opts->emit != 1u << EMIT_BC) {
+			fprintf(stderr, "Error: --thinlto writes bitcode, it cannot be used with other outputs\n");
+			return false;
+		}
+		for (size_t i = 0; i < sizeof(thinlto_pipelines) / sizeof(thinlto_pipelines[0]); i++) {
+			if (opts->opt_pipeline != NULL && strcmp(opts->opt_pipeline, thinlto_pipelines[i][0]) == 0)
+				opts->opt_pipeline = thinlto_pipelines[i][1];
+		}
+	}
+	if (to_stdout) {
+		if (count_emit_kinds(opts->emit) != 1) {
+			fprintf(stderr, "Error: only one output kind can be written to stdout\n");
+			return false;
+		}
+		if (opts->emit & (1u << EMIT_EXE)) {
+			fprintf(stderr, "Error: an executable cannot be written to stdout\n");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static const struct options *cur_opts;
+// whether a phase has begun and not ended, for ending it when a compile jumps out of it
+static bool phase_open = false;
+
+static void phase_begin(const char *phase) {
+	phase_open = true;
+	if (cur_opts->mem_report != MEM_REPORT_NONE)
+		mem_report_begin(phase);
+	if (cur_opts->time_report)
+		time_report_begin(phase);
+}
+static void phase_end(void) {
+	phase_open = false;
+	if (cur_opts->time_report)
+		time_report_end();
+	if (cur_opts->mem_report != MEM_REPORT_NONE)
+		mem_report_end();
+}
+
+// the output path of each kind written (NULL for the others), see options.output
+// returns false on malloc failure, the paths made so far are still to be freed
+static bool make_output_paths(
+	const struct options *opts,
+	const char *module_name,
+	char *paths[EMIT_KINDS]
+) {
+	for (enum emit_kind kind = 0; kind < EMIT_KINDS; kind++)
+		paths[kind] = NULL;
+
+	for (enum emit_kind kind = 0; kind < EMIT_KINDS; kind++) {
+		if (!(opts->emit & (1u << kind)))
+			continue;
+
+		if (opts->output != NULL && count_emit_kinds(opts->emit) == 1)
+			paths[kind] = with_extension(opts->output, "");
+		else
+			paths[kind] = with_extension(
+				opts->output != NULL ? opts->output : module_name, emit_extensions[kind]
+			);
+		if (paths[kind] == NULL)
+			return false;
+	}
+	return true;
+}
+
+// everything in opts that changes the output of kind, for the cache key
+// (kinds written together share a module, so all of them are part of it)
+// returns NULL on malloc failure
+static char *cache_config(const struct options *opts, const char *module_name, enum emit_kind kind) {
+	const char *pipeline = opts->passes != NULL ? opts->passes : opts->opt_pipeline;
+	// --mcpu=native is what it resolves to on this host (as in codegen/emit.c), a shared
+	// cache must not give code for another CPU
+	bool native = opts->target.cpu != NULL && strcmp(opts->target.cpu, EMIT_CPU_NATIVE) == 0;
+	char *host_cpu = native ? LLVMGetHostCPUName() : NULL;
+	char *host_features = native ? LLVMGetHostCPUFeatures() : NULL;
+	// debug info names the source file and the directory it was compiled in
+	char dir[PATH_MAX] = "";
+	if (opts->codegen.debug_file != NULL && getcwd(dir, sizeof(dir)) == NULL)
+		dir[0] = 0;
+	// measured with a NULL buffer first, then written
+#define OR_EMPTY(str) ((str) != NULL ? (str) : "")
+#define WRITE_CACHE_CONFIG(buffer, size) snprintf( \
+		buffer, size, "module=%s emit=%u kind=%s lowering=%d overflow=%d discard_names=%d " \
+		"level=%u passes=%s target=%s cpu=%s features=%s host_cpu=%s host_features=%s " \
+		"thinlto=%d debug=%s dir=%s", \
+		module_name, opts->emit, emit_names[kind], opts->codegen.lowering, opts->codegen.overflow, \
+		opts->codegen.discard_names, opts->opt_level, OR_EMPTY(pipeline), \
+		OR_EMPTY(opts->target.triple), OR_EMPTY(opts->target.cpu), OR_EMPTY(opts->target.features), \
+		OR_EMPTY(host_cpu), OR_EMPTY(host_features), \
+		opts->thinlto, OR_EMPTY(opts->codegen.debug_file), dir \
+	)
+
+	size_t len = WRITE_CACHE_CONFIG(NULL, 0);
+	char *config = malloc(len + 1);
+	if (config != NULL)
+		WRITE_CACHE_CONFIG(config, len + 1);
+	if (native) {
+		LLVMDisposeMessage(host_cpu);
+		LLVMDisposeMessage(host_features);
+	}
+	return config;
+#undef WRITE_CACHE_CONFIG
+#undef OR_EMPTY
+}
+
+static bool write_output(
+	const struct options *opts,
+	LLVMModuleRef module,
+	LLVMTargetMachineRef machine,
+	enum emit_kind kind,
+	char *const paths[EMIT_KINDS]
+) {
+	switch (kind) {
+		case EMIT_BC:
+			if (opts->thinlto)
+				return thinlto_write_bitcode(module, paths[kind]);
+			return codegen_write_bitcode(module, paths[kind]);
+		case EMIT_LL:
+			return codegen_write_ir(module, paths[kind]);
+		case EMIT_ASM:
+			return emit_machine_code(module, machine, LLVMAssemblyFile, paths[kind]);
+		case EMIT_OBJ:
+			return emit_machine_code(module, machine, LLVMObjectFile, paths[kind]);
+		case EMIT_EXE:
+			// linked from the object file if that is written anyway
+			if (paths[EMIT_OBJ] != NULL)
+				return emit_link_executable((const char *const *) &paths[EMIT_OBJ], 1, paths[kind]);
+			return emit_executable(module, machine, paths[kind]);
+		case EMIT_KINDS:
+			break;
+	}
+	return false;
+}
+
+// lex, parse, the passes and codegen, everything that allocates through utils/alloc.h
+// returns the module, or NULL (after printing why) if the source does not parse
+static LLVMModuleRef front_end(
+	const struct options *opts,
+	char **lines,
+	size_t *line_lens,
+	size_t num_lines,
+	const char *module_name
+) {
+	struct lex_token_list token_list = lex_new_token_list();
+	phase_begin("lex_scan");
+	lex_scan(num_lines, (const char **) lines, line_lens, &token_list);
+	phase_end();
+
+	// for (size_t i = 0; i < token_list.size; i++)
+	// 	lex_print_token(&token_list.l[i]);
+
+	struct ast_node root = ast_new_node(AST_ROOT);
+	phase_begin("parse");
+	bool ok = parse(&token_list, (const char **) lines, &root);
+	phase_end();
+
+	LLVMModuleRef module = NULL;
+	if (ok) {
+		// stdout belongs to the program with --run, or to the output with -o -
+		bool to_stdout = opts->output != NULL && strcmp(opts->output, CODEGEN_STDOUT) == 0;
+		if (!opts->run && !to_stdout) {
+			phase_begin("ast_print");
+			ast_print(&root);
+			phase_end();
+		}
+
+		phase_begin("fold");
+		fold_constants(&root, opts->codegen.overflow == CODEGEN_OVERFLOW_TRAP);
+		phase_end();
+
+		phase_begin("reachability");
+		reachability_remove_dead(&root);
+		phase_end();
+
+		phase_begin("liveness");
+		liveness_mark_dead_stores(&root, opts->codegen.overflow == CODEGEN_OVERFLOW_TRAP);
+		phase_end();
+
+		phase_begin("codegen");
+		module = codegen(module_name, &root, &opts->codegen);
+		phase_end();
+	}
+
+	ast_free_node(&root);
+	// lex_free_token_list(&token_list);
+
+	return module;
+}
+
+// front_end with a fail jump of its own, returns NULL (after printing why) if it fails or
+// runs out of memory, the memory of a compile that ran out is left to its allocator
+static LLVMModuleRef try_front_end(
+	const struct options *opts,
+	char **lines,
+	size_t *line_lens,
+	size_t num_lines,
+	const char *module_name
+) {
+	jmp_buf jump;
+	jmp_buf *prev = alloc_set_fail_jump(&jump);
+	LLVMModuleRef module = NULL;
+	if (!setjmp(jump))
+		module = front_end(opts, lines, line_lens, num_lines, module_name);
+	else {
+		if (phase_open)
+			phase_end();
+		alloc_print_failure(stderr);
+	}
+	alloc_set_fail_jump(prev);
+	return module;
+}
+
+// the front end, then the outputs opts asks for (written to paths)
+// returns false (after printing why) on failure
+static bool compile(
+	const struct options *opts,
+	char **lines,
+	size_t *line_lens,
+	size_t num_lines,
+	const char *module_name,
+	char *const paths[EMIT_KINDS],
+	int *exit_code
+) {
+	// with --mem-limit the front end's memory comes from a pool, released when it is done
+	struct alloc_pool *pool = NULL;
+	struct allocator allocator;
+	if (opts->mem_limit != 0) {
+		pool = alloc_pool_new(opts->mem_limit);
+		if (pool == NULL) {
+			fprintf(stderr, "Error: malloc failure\n");
+			return false;
+		}
+		allocator = alloc_pool_allocator(pool);
+		alloc_set_all(&allocator);
+	}
+
+	LLVMModuleRef module = try_front_end(opts, lines, line_lens, num_lines, module_name);
+
+	if (pool != NULL) {
+		alloc_set_all(NULL);
+		alloc_pool_free(pool);
+	}
+	if (module == NULL)
+		return false;
+
+	// the optimizer is told about the target too, and with --target, --mcpu or
+	// --mattr bitcode and IR are for that target as well (ThinLTO needs it anyway)
+	bool ok = true;
+	LLVMTargetMachineRef machine = NULL;
+	bool target_given = opts->target.triple != NULL || opts->target.cpu != NULL ||
+		opts->target.features != NULL;
+	if ((opts->emit & EMIT_NATIVE) || opts->run || opts->thinlto || target_given) {
+		machine = emit_create_target_machine(&opts->target, opts->opt_level);
+		if (machine == NULL)
+			ok = false;
+		else
+			emit_set_target(module, machine);
+	}
+
+	// in process, on the module in memory
+	const char *pipeline = opts->passes != NULL ? opts->passes : opts->opt_pipeline;
+	if (ok && pipeline != NULL) {
+		phase_begin("optimize");
+		ok = codegen_optimize(module, pipeline, machine);
+		phase_end();
+	}
+
+	if (ok && opts->run) {
+		phase_begin("run");
+		ok = jit_run_main(module, opts->opt_level, opts->jit_perf, exit_code);
+		phase_end();
+	}
+
+	for (enum emit_kind kind = 0; ok && kind < EMIT_KINDS; kind++) {
+		if (paths[kind] == NULL)
+			continue;
+
+		phase_begin(emit_phases[kind]);
+		ok = write_output(opts, module, machine, kind, paths);
+		phase_end();
+	}
+
+	if (machine != NULL)
+		emit_dispose_target_machine(machine);
+	codegen_dispose(module);
+
+	return ok;
+}
+
 int main(int argc, const char *argv[]) {
-	if (argc != 2) {
-		fprintf(stderr, "Error: need exactly two arguments\n");
+	struct options opts;
+	if (!parse_args(argc, argv, &opts))
 		return 1;
+	cur_opts = &opts;
+
+	// LLVM's own pass timers are printed along with ours
+	if (opts.time_report)
+		codegen_enable_time_passes();
+
+	// a driver step of its own, there is no source to compile
+	if (opts.thinlto_link) {
+		phase_begin("thinlto_link");
+		bool ok = thinlto_link(opts.inputs, opts.num_inputs, &opts.target,
+			opts.output != NULL ? opts.output : "a.out");
+		phase_end();
+
+		if (opts.mem_report != MEM_REPORT_NONE)
+			mem_report_print(stderr, opts.mem_report == MEM_REPORT_JSON);
+		if (opts.time_report)
+			time_report_print(stderr);
+		return ok ? 0 : 1;
 	}
 
-	FILE *infile = fopen(argv[1], "r");
+	phase_begin("load");
+	FILE *infile = fopen(opts.filename, "r");
 	if (infile == NULL) {
 		fprintf(stderr, "Error: failure reading file\n");
 		return 1;
@@ -97,38 +744,72 @@ int main(int argc, const char *argv[]) {
 	// that value will be line_counter + 1
 
 	fclose(infile);
+	phase_end();
 
-	struct lex_token_list token_list = lex_new_token_list();
-	lex_scan(num_lines, (const char **) lines, line_lens, &token_list);
-
-	// for (size_t i = 0; i < token_list.size; i++)
-	// 	lex_print_token(&token_list.l[i]);
+	// with --run nothing is written, the paths are all NULL
+	char *module_name = get_module_name(opts.filename);
+	char *paths[EMIT_KINDS] = { NULL };
+	bool ok = module_name != NULL && (opts.run || make_output_paths(&opts, module_name, paths));
+	if (!ok)
+		fprintf(stderr, "Error: malloc failure\n");
 
-	struct ast_node root = ast_new_node(AST_ROOT);
-	bool ok = parse(&token_list, (const char **) lines, &root);
+	// main's return value with --run
+	int exit_code = 0;
 
-	if (ok) {
-		ast_print(&root);
+	// executables are not cached (they are linked from a new object file), nor is stdout
+	bool to_stdout = opts.output != NULL && strcmp(opts.output, CODEGEN_STDOUT) == 0;
+	struct cache cache;
+	bool cache_opened = ok && opts.cache && !opts.run && !to_stdout &&
+		!(opts.emit & (1u << EMIT_EXE)) && cache_open(&cache, opts.cache_dir, opts.cache_max_bytes);
+	// a hit needs every output kind, each is its own entry
+	char keys[EMIT_KINDS][CACHE_KEY_SIZE];
+	bool cacheable = false, hit = false;
+	if (cache_opened) {
+		phase_begin("cache_lookup");
+		cacheable = hit = true;
+		for (enum emit_kind kind = 0; cacheable && kind < EMIT_KINDS; kind++) {
+			if (paths[kind] == NULL)
+				continue;
 
-		char *module_name = get_module_name(argv[1]);
-		if (module_name == NULL) {
-			fprintf(stderr, "Error: malloc failure\n");
-			ok = false;
+			char *config = cache_config(&opts, module_name, kind);
+			cacheable = config != NULL;
+			if (cacheable)
+				cache_make_key(&cache, keys[kind], config, (const char *const *) lines, line_lens, num_lines);
+			hit = cacheable && hit && cache_fetch(&cache, keys[kind], paths[kind]);
+			free(config);
 		}
-		else {
-			codegen(module_name, &root);
-			free(module_name);
+		phase_end();
+	}
+
+	if (ok && !hit) {
+		ok = compile(&opts, lines, line_lens, num_lines, module_name, paths, &exit_code);
+
+		if (ok && cacheable) {
+			phase_begin("cache_store");
+			for (enum emit_kind kind = 0; kind < EMIT_KINDS; kind++) {
+				if (paths[kind] != NULL)
+					cache_store(&cache, keys[kind], paths[kind]);
+			}
+			phase_end();
 		}
 	}
 
-	ast_free_node(&root);
-	// lex_free_token_list(&token_list);
+	if (cache_opened)
+		cache_close(&cache);
+	for (enum emit_kind kind = 0; kind < EMIT_KINDS; kind++)
+		free(paths[kind]);
+	free(module_name);
+
+	if (opts.mem_report != MEM_REPORT_NONE)
+		mem_report_print(stderr, opts.mem_report == MEM_REPORT_JSON);
+	if (opts.time_report)
+		time_report_print(stderr);
 
 	for (size_t i = 0; i <= line_counter; i++)
 		free(lines[i]);
 	free(lines);
 	free(line_lens);
 
-	return ok ? 0 : 1;
+	return ok ? exit_code : 1;
 };
 
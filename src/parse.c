@@ -428,7 +428,7 @@ static void goal(struct ast_node *node) {
 	size_t new_index = ast_insert_node(node, AST_STMT_LIST);
 	bool ok = statement_list(&node->value.children.l[new_index]);
 
-	printf("success? %u\n", ok);
+	fprintf(stderr, "success? %u\n", ok);
 }
 
 bool parse(const struct lex_token_list *tokens, const char **lines, struct ast_node *root) {
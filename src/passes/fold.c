@@ -0,0 +1,585 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "passes/fold.h"
+#include "utils/strmap.h"
+#include "utils/alloc.h"
+#include "ast.h"
+#include "lex.h"
+
+// values of the variables at a point of the program (name -> struct fold_value)
+// every variable in scope has an entry, known or not, so it follows codegen's var_map
+struct fold_value {
+	bool known;
+	int32_t value;
+};
+
+// arithmetic wraps like the generated i32 instructions
+// checked (overflow traps at runtime): operations that overflow are not folded
+static bool eval_op(enum lex_token_type op, int32_t lhs, int32_t rhs, int32_t *out, bool checked) {
+	int64_t wide;
+	switch (op) {
+		case LEX_PLUS:
+			wide = (int64_t) lhs + rhs;
+			break;
+		case LEX_MINUS:
+			wide = (int64_t) lhs - rhs;
+			break;
+		case LEX_STAR:
+			wide = (int64_t) lhs * rhs;
+			break;
+		case LEX_SLASH:
+		case LEX_PERCENT:
+			// left for the program to do at runtime
+			if (rhs == 0 || (lhs == INT32_MIN && rhs == -1))
+				return false;
+			*out = op == LEX_SLASH ? lhs / rhs : lhs % rhs;
+			return true;
+		case LEX_EQUAL_EQUAL:
+			*out = lhs == rhs;
+			return true;
+		case LEX_BANG_EQUAL:
+			*out = lhs != rhs;
+			return true;
+		case LEX_LESS:
+			*out = lhs < rhs;
+			return true;
+		case LEX_LESS_EQUAL:
+			*out = lhs <= rhs;
+			return true;
+		case LEX_GREATER:
+			*out = lhs > rhs;
+			return true;
+		case LEX_GREATER_EQUAL:
+			*out = lhs >= rhs;
+			return true;
+		default:
+			return false;
+	}
+
+	if (checked && (wide < INT32_MIN || wide > INT32_MAX))
+		return false;
+	*out = (int32_t) (uint32_t) wide;
+	return true;
+}
+
+static struct ast_node new_leaf(enum lex_token_type type, int32_t number, size_t line) {
+	struct ast_node leaf = { .type = AST_LEAF, .flags = 0 };
+	leaf.value.token.type = type;
+	leaf.value.token.literal.number = number;
+	leaf.value.token.line = line;
+	switch (type) {
+		case LEX_PLUS:
+			leaf.value.token.str = "+";
+			break;
+		case LEX_MINUS:
+			leaf.value.token.str = "-";
+			break;
+		case LEX_STAR:
+			leaf.value.token.str = "*";
+			break;
+		default:
+			leaf.value.token.str = "(folded)";
+	}
+	return leaf;
+}
+
+// a constant in the form the parser would give it: EXPR -> EXPR_NO_COMP -> TERM -> FACTOR -> number
+static struct ast_node constant_node(enum ast_node_type type, int32_t value, size_t line) {
+	if (type == AST_LEAF)
+		return new_leaf(LEX_NUMBER, value, line);
+
+	enum ast_node_type child_type;
+	switch (type) {
+		case AST_EXPR:
+			child_type = AST_EXPR_NO_COMP;
+			break;
+		case AST_EXPR_NO_COMP:
+			child_type = AST_TERM;
+			break;
+		case AST_TERM:
+			child_type = AST_FACTOR;
+			break;
+		case AST_FACTOR:
+			child_type = AST_LEAF;
+			break;
+		default:
+			fprintf(stderr, "ERROR! (23)\n");
+			exit(1);
+	}
+
+	struct ast_node node = ast_new_node(type);
+	ast_node_list_append(&node.value.children, constant_node(child_type, value, line));
+	return node;
+}
+
+static size_t first_line(const struct ast_node *node) {
+	if (node->type == AST_LEAF)
+		return node->value.token.line;
+	if (node->value.children.size == 0)
+		return 0;
+	return first_line(&node->value.children.l[0]);
+}
+
+static void make_constant(struct ast_node *node, int32_t value, size_t line) {
+	enum ast_node_type type = node->type;
+	ast_free_node(node);
+	*node = constant_node(type, value, line);
+}
+
+static void set_constant(struct ast_node *node, int32_t value) {
+	make_constant(node, value, first_line(node));
+}
+
+// swap in a rebuilt child list, nodes that were not moved into it must be freed already
+static void replace_children(struct ast_node *node, struct ast_node_list children) {
+	alloc_free(ALLOC_AST, node->value.children.l);
+	node->value.children = children;
+}
+
+static bool fold_expression(struct ast_node *node, const struct strmap *env, int32_t *value, bool checked);
+
+static void fold_call(struct ast_node *node, const struct strmap *env, bool checked) {
+	struct ast_node_list *args = &node->value.children.l[1].value.children;
+	int32_t value;
+	for (size_t i = 0; i < args->size; i++)
+		fold_expression(&args->l[i], env, &value, checked);
+}
+
+static bool fold_factor(struct ast_node *node, const struct strmap *env, int32_t *value, bool checked) {
+	struct ast_node *child = &node->value.children.l[0];
+
+	if (child->type == AST_LEAF) {
+		if (child->value.token.type == LEX_NUMBER) {
+			*value = child->value.token.literal.number;
+			return true;
+		}
+
+		const struct fold_value *var = strmap_get(env, child->value.token.str);
+		if (var == NULL || !var->known)
+			return false;
+		*value = var->value;
+	}
+	else if (child->type == AST_EXPR) {
+		if (!fold_expression(child, env, value, checked))
+			return false;
+	}
+	else {
+		fold_call(child, env, checked);
+		return false;
+	}
+
+	set_constant(node, *value);
+	return true;
+}
+
+// only multiplication: all constant factors are multiplied into one, put last
+static bool fold_product(struct ast_node *node, int32_t *value, bool checked) {
+	struct ast_node_list *list = &node->value.children;
+	struct ast_node_list factors = ast_new_node_list();
+	int32_t product = 1;
+	size_t line = first_line(node);
+
+	for (size_t i = 0; i < list->size; i += 2) {
+		int32_t factor;
+		if (ast_get_constant(&list->l[i], &factor)) {
+			eval_op(LEX_STAR, product, factor, &product, checked);
+			ast_free_node(&list->l[i]);
+			continue;
+		}
+		if (factors.size != 0)
+			ast_node_list_append(&factors, new_leaf(LEX_STAR, 0, line));
+		ast_node_list_append(&factors, list->l[i]);
+	}
+
+	// x * 0, unless x has side effects
+	bool zero = product == 0;
+	for (size_t i = 0; zero && i < factors.size; i += 2) {
+		if (ast_contains(&factors.l[i], AST_FUNC_CALL))
+			zero = false;
+	}
+
+	if (factors.size == 0 || zero) {
+		ast_free_node_list(&factors);
+		replace_children(node, ast_new_node_list());
+		make_constant(node, product, line);
+		*value = product;
+		return true;
+	}
+
+	// x * 1 is x
+	if (product != 1) {
+		ast_node_list_append(&factors, new_leaf(LEX_STAR, 0, line));
+		ast_node_list_append(&factors, constant_node(AST_FACTOR, product, line));
+	}
+	replace_children(node, factors);
+	return false;
+}
+
+static bool fold_term(struct ast_node *node, const struct strmap *env, int32_t *value, bool checked) {
+	struct ast_node_list *list = &node->value.children;
+
+	bool all_mul = true;
+	for (size_t i = 0; i < list->size; i++) {
+		if (i % 2 == 1)
+			all_mul = all_mul && list->l[i].value.token.type == LEX_STAR;
+		else
+			fold_factor(&list->l[i], env, value, checked);
+	}
+
+	// multiplication alone can be reordered (it wraps), division and modulo can not
+	// when overflow traps, the order decides whether it traps
+	if (all_mul && !checked)
+		return fold_product(node, value, checked);
+
+	// left to right: fold constant operations, drop * 1 and / 1
+	// two constants are only combined when the last one is the whole left operand (the
+	// first factor), or is multiplied and so is everything before it (x * 2 * 3 is x * 6,
+	// x / 10 * 10 is not x / 100), when overflow traps only the first
+	struct ast_node_list factors = ast_new_node_list();
+	ast_node_list_append(&factors, list->l[0]);
+	bool prefix_mul = !checked;
+	for (size_t i = 1; i < list->size; i += 2) {
+		struct ast_node *op = &list->l[i], *factor = &list->l[i + 1];
+		struct ast_node *last = &factors.l[factors.size - 1];
+		enum lex_token_type op_type = op->value.token.type;
+
+		int32_t lhs, rhs, result;
+		bool lhs_const = ast_get_constant(last, &lhs), rhs_const = ast_get_constant(factor, &rhs);
+		bool combine = factors.size == 1 || (prefix_mul && op_type == LEX_STAR);
+		if (combine && lhs_const && rhs_const && eval_op(op_type, lhs, rhs, &result, checked)) {
+			set_constant(last, result);
+			ast_free_node(factor);
+		}
+		else if (rhs_const && rhs == 1 && op_type != LEX_PERCENT)
+			ast_free_node(factor);
+		else if (lhs_const && lhs == 1 && op_type == LEX_STAR && factors.size == 1) {
+			ast_free_node(last);
+			*last = *factor;
+		}
+		else {
+			prefix_mul = prefix_mul && op_type == LEX_STAR;
+			ast_node_list_append(&factors, *op);
+			ast_node_list_append(&factors, *factor);
+		}
+	}
+	replace_children(node, factors);
+
+	if (!ast_get_constant(node, value))
+		return false;
+	set_constant(node, *value);
+	return true;
+}
+
+// the constant sum a term list starts with, as the parser would give it
+static void append_sum(struct ast_node_list *terms, int32_t sum, size_t line) {
+	bool negative = sum < 0 && sum != INT32_MIN;
+	if (negative)
+		ast_node_list_append(terms, new_leaf(LEX_MINUS, 0, line));
+	ast_node_list_append(terms, constant_node(AST_TERM, negative ? -sum : sum, line));
+}
+
+// checked: the terms keep their order, only the constant ones the sum starts with
+// are added up (unless that overflows) and later + 0 / - 0 are dropped
+static bool fold_sum_in_order(struct ast_node *node, const struct strmap *env, int32_t *value) {
+	struct ast_node_list *list = &node->value.children;
+	struct ast_node_list terms = ast_new_node_list();
+	int32_t sum = 0;
+	bool prefix = true;
+	size_t line = first_line(node);
+
+	size_t first = list->l[0].type == AST_LEAF ? 1 : 0;
+	for (size_t i = first; i < list->size; i += 2) {
+		struct ast_node *sign = i == 0 ? NULL : &list->l[i - 1];
+		bool minus = sign != NULL && sign->value.token.type == LEX_MINUS;
+
+		int32_t term;
+		bool is_const = fold_term(&list->l[i], env, &term, true);
+		if (is_const && (prefix ? eval_op(minus ? LEX_MINUS : LEX_PLUS, sum, term, &sum, true) : term == 0)) {
+			ast_free_node(&list->l[i]);
+			continue;
+		}
+
+		if (prefix && sum != 0)
+			append_sum(&terms, sum, line);
+		prefix = false;
+
+		if (terms.size != 0)
+			ast_node_list_append(&terms, *sign);
+		else if (minus)
+			ast_node_list_append(&terms, new_leaf(LEX_MINUS, 0, sign->value.token.line));
+		ast_node_list_append(&terms, list->l[i]);
+	}
+
+	if (prefix) {
+		replace_children(node, terms);
+		make_constant(node, sum, line);
+		*value = sum;
+		return true;
+	}
+	replace_children(node, terms);
+	return false;
+}
+
+// constant terms are summed into one, put last
+static bool fold_expr_no_comp(struct ast_node *node, const struct strmap *env, int32_t *value, bool checked) {
+	if (checked)
+		return fold_sum_in_order(node, env, value);
+
+	struct ast_node_list *list = &node->value.children;
+	struct ast_node_list terms = ast_new_node_list();
+	int32_t sum = 0;
+	size_t line = first_line(node);
+
+	size_t first = list->l[0].type == AST_LEAF ? 1 : 0;
+	for (size_t i = first; i < list->size; i += 2) {
+		// sign of the term: the leading +/- or the operator before it
+		struct ast_node *sign = i == 0 ? NULL : &list->l[i - 1];
+		bool minus = sign != NULL && sign->value.token.type == LEX_MINUS;
+
+		int32_t term;
+		if (fold_term(&list->l[i], env, &term, checked)) {
+			eval_op(minus ? LEX_MINUS : LEX_PLUS, sum, term, &sum, checked);
+			ast_free_node(&list->l[i]);
+			continue;
+		}
+
+		// the first term only keeps its sign if it is negative
+		if (terms.size != 0)
+			ast_node_list_append(&terms, *sign);
+		else if (minus)
+			ast_node_list_append(&terms, new_leaf(LEX_MINUS, 0, sign->value.token.line));
+		ast_node_list_append(&terms, list->l[i]);
+	}
+
+	if (terms.size == 0) {
+		replace_children(node, terms);
+		make_constant(node, sum, line);
+		*value = sum;
+		return true;
+	}
+
+	// x + 0 is x
+	if (sum != 0) {
+		bool negative = sum < 0 && sum != INT32_MIN;
+		ast_node_list_append(&terms, new_leaf(negative ? LEX_MINUS : LEX_PLUS, 0, line));
+		ast_node_list_append(&terms, constant_node(AST_TERM, negative ? -sum : sum, line));
+	}
+	replace_children(node, terms);
+	return false;
+}
+
+static bool fold_expression(struct ast_node *node, const struct strmap *env, int32_t *value, bool checked) {
+	struct ast_node_list *list = &node->value.children;
+
+	if (list->size == 1)
+		return fold_expr_no_comp(&list->l[0], env, value, checked);
+
+	int32_t lhs, rhs;
+	bool lhs_const = fold_expr_no_comp(&list->l[0], env, &lhs, checked);
+	bool rhs_const = fold_expr_no_comp(&list->l[2], env, &rhs, checked);
+	if (!lhs_const || !rhs_const || !eval_op(list->l[1].value.token.type, lhs, rhs, value, checked))
+		return false;
+
+	set_constant(node, *value);
+	return true;
+}
+
+static void env_set(struct strmap *env, const char *name, bool known, int32_t value) {
+	struct fold_value var = { .known = known, .value = value };
+	strmap_set(env, name, &var, sizeof(var));
+}
+
+// keeps the variables in env (the scope before a branch), known if a and b agree
+static void env_merge(struct strmap *env, const struct strmap *a, const struct strmap *b) {
+	for (uint64_t i = 0; i < env->bucket_count; i++) {
+		for (struct strmap_list_node *cur = env->list[i]; cur != NULL; cur = cur->next) {
+			const struct fold_value *var_a = strmap_get(a, cur->str);
+			const struct fold_value *var_b = strmap_get(b, cur->str);
+			struct fold_value *var = cur->value;
+			var->known = var_a->known && var_b->known && var_a->value == var_b->value;
+			var->value = var_a->value;
+		}
+	}
+}
+
+static void collect_assigned(const struct ast_node *node, struct strmap *names) {
+	if (node->type == AST_LEAF)
+		return;
+
+	if (node->type == AST_ASSIGN && node->value.children.size == 2) {
+		bool assigned = true;
+		strmap_set(names, node->value.children.l[0].value.token.str, &assigned, sizeof(assigned));
+		return;
+	}
+
+	for (size_t i = 0; i < node->value.children.size; i++)
+		collect_assigned(&node->value.children.l[i], names);
+}
+
+static void fold_assign(struct ast_node *node, struct strmap *env, bool checked) {
+	if (node->value.children.size != 2)
+		return;
+
+	int32_t value;
+	bool known = fold_expression(&node->value.children.l[1], env, &value, checked);
+	env_set(env, node->value.children.l[0].value.token.str, known, value);
+}
+
+static bool fold_stmt_list(struct ast_node *node, struct strmap *env, bool checked);
+
+// returns true if the whole statement can be removed
+static bool fold_conditional(struct ast_node *node, struct strmap *env, bool checked) {
+	struct ast_node_list *list = &node->value.children;
+
+	int32_t condition;
+	bool is_const = fold_expression(&list->l[0], env, &condition, checked);
+
+	struct strmap env_then = strmap_copy(env), env_else = strmap_copy(env);
+	bool then_terminated = fold_stmt_list(&list->l[1], &env_then, checked);
+	bool else_terminated = list->size == 3 && fold_stmt_list(&list->l[2], &env_else, checked);
+
+	bool remove = false;
+	if (is_const && condition != 0) {
+		if (list->size == 3)
+			ast_remove_node(node, 2);
+		env_merge(env, &env_then, &env_then);
+	}
+	else if (is_const && list->size == 2)
+		remove = true;
+	else if (is_const) {
+		// only the else branch is left, it becomes an if (1)
+		ast_free_node(&list->l[1]);
+		list->l[1] = list->l[2];
+		list->size--;
+		set_constant(&list->l[0], 1);
+		env_merge(env, &env_else, &env_else);
+	}
+	// a branch that ends in return/break/continue does not reach the code after the if
+	else if (then_terminated && !else_terminated)
+		env_merge(env, &env_else, &env_else);
+	else if (else_terminated && !then_terminated)
+		env_merge(env, &env_then, &env_then);
+	else
+		env_merge(env, &env_then, &env_else);
+
+	strmap_free(&env_then);
+	strmap_free(&env_else);
+	return remove;
+}
+
+static void fold_for_loop(struct ast_node *node, struct strmap *env, bool checked) {
+	struct ast_node_list *list = &node->value.children;
+	struct ast_node *init = &list->l[0], *cond = &list->l[1];
+	struct ast_node *step = &list->l[2], *body = &list->l[3];
+
+	// the loop variable goes out of scope after the loop if it is new
+	const char *loop_var = NULL;
+	if (init->value.children.size != 0) {
+		loop_var = init->value.children.l[0].value.token.str;
+		if (strmap_get(env, loop_var) != NULL)
+			loop_var = NULL;
+	}
+	fold_assign(init, env, checked);
+
+	// with the values on entry, the condition may show the loop never runs
+	// (or always runs at least once)
+	bool never_runs = false;
+	if (cond->value.children.size != 0) {
+		struct ast_node entry_cond = ast_copy_node(cond);
+		int32_t value;
+		if (fold_expression(&entry_cond, env, &value, checked)) {
+			never_runs = value == 0;
+			if (!never_runs)
+				node->flags |= AST_FLAG_LOOP_ENTERS;
+		}
+		ast_free_node(&entry_cond);
+	}
+	else
+		node->flags |= AST_FLAG_LOOP_ENTERS;
+
+	int32_t value;
+	if (never_runs) {
+		fold_expression(cond, env, &value, checked);
+		ast_free_node(step);
+		*step = ast_new_node(AST_ASSIGN);
+		ast_free_node(body);
+		*body = ast_new_node(AST_STMT_LIST);
+	}
+	else {
+		// anything assigned in the loop is unknown in it and after it
+		struct strmap assigned = strmap_new();
+		collect_assigned(body, &assigned);
+		collect_assigned(step, &assigned);
+		for (uint64_t i = 0; i < env->bucket_count; i++) {
+			for (struct strmap_list_node *cur = env->list[i]; cur != NULL; cur = cur->next) {
+				if (strmap_get(&assigned, cur->str) != NULL)
+					((struct fold_value *) cur->value)->known = false;
+			}
+		}
+		strmap_free(&assigned);
+
+		// an always true condition is the same as none
+		if (cond->value.children.size != 0 && fold_expression(cond, env, &value, checked) && value != 0) {
+			ast_free_node(cond);
+			*cond = ast_new_node(AST_EXPR);
+		}
+
+		struct strmap env_body = strmap_copy(env);
+		fold_stmt_list(body, &env_body, checked);
+		strmap_free(&env_body);
+
+		if (step->value.children.size != 0)
+			fold_expression(&step->value.children.l[1], env, &value, checked);
+	}
+
+	if (loop_var != NULL)
+		strmap_remove(env, loop_var, false);
+}
+
+// returns true if the list ends in return/break/continue
+static bool fold_stmt_list(struct ast_node *node, struct strmap *env, bool checked) {
+	struct ast_node_list *list = &node->value.children;
+	bool terminated = false;
+
+	for (size_t i = 0; i < list->size; i++) {
+		struct ast_node *child = &list->l[i].value.children.l[0];
+		int32_t value;
+		switch (child->type) {
+			case AST_ASSIGN:
+				fold_assign(child, env, checked);
+				break;
+			case AST_FUNC_CALL:
+				fold_call(child, env, checked);
+				break;
+			case AST_RETURN:
+				fold_expression(&child->value.children.l[0], env, &value, checked);
+				terminated = true;
+				break;
+			case AST_CONDITIONAL:
+				if (fold_conditional(child, env, checked))
+					ast_remove_node(node, i--);
+				break;
+			case AST_FOR:
+				fold_for_loop(child, env, checked);
+				break;
+			case AST_CONTINUE:
+			case AST_BREAK:
+				terminated = true;
+				break;
+			default:
+				fprintf(stderr, "ERROR! (24)\n");
+				exit(1);
+		}
+	}
+
+	return terminated;
+}
+
+void fold_constants(struct ast_node *root, bool checked) {
+	struct strmap env = strmap_new();
+	fold_stmt_list(&root->value.children.l[0], &env, checked);
+	strmap_free(&env);
+}
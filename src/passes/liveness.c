@@ -0,0 +1,248 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "passes/liveness.h"
+#include "utils/strmap.h"
+#include "ast.h"
+#include "lex.h"
+
+// live variable sets are strmaps used as sets (name -> true)
+// the statement lists are walked backwards: "live" holds the variables live
+// after the statement on entry and the variables live before it on return
+
+// where control goes on break/continue in the innermost loop
+struct loop_live {
+	const struct strmap *break_live, *continue_live;
+};
+
+static bool set_has(const struct strmap *set, const char *name) {
+	return strmap_get(set, name) != NULL;
+}
+
+static void set_add(struct strmap *set, const char *name) {
+	if (set_has(set, name))
+		return;
+	bool live = true;
+	strmap_set(set, name, &live, sizeof(live));
+}
+
+static void set_remove(struct strmap *set, const char *name) {
+	if (set_has(set, name))
+		strmap_remove(set, name, false);
+}
+
+static void set_union(struct strmap *dest, const struct strmap *src) {
+	for (uint64_t i = 0; i < src->bucket_count; i++) {
+		for (struct strmap_list_node *cur = src->list[i]; cur != NULL; cur = cur->next)
+			set_add(dest, cur->str);
+	}
+}
+
+static bool set_subset(const struct strmap *a, const struct strmap *b) {
+	for (uint64_t i = 0; i < a->bucket_count; i++) {
+		for (struct strmap_list_node *cur = a->list[i]; cur != NULL; cur = cur->next) {
+			if (!set_has(b, cur->str))
+				return false;
+		}
+	}
+	return true;
+}
+
+static void set_assign(struct strmap *dest, const struct strmap *src) {
+	strmap_free(dest);
+	*dest = strmap_copy(src);
+}
+
+// every variable read in an expression, function names are not variables
+static void add_uses(struct strmap *live, const struct ast_node *node) {
+	if (node->type == AST_LEAF) {
+		if (node->value.token.type == LEX_IDENTIFIER)
+			set_add(live, node->value.token.str);
+		return;
+	}
+
+	const struct ast_node_list *list = &node->value.children;
+	for (size_t i = node->type == AST_FUNC_CALL ? 1 : 0; i < list->size; i++)
+		add_uses(live, &list->l[i]);
+}
+
+// for loop init/step assignments may be empty (no children)
+static void live_assign(const struct ast_node *node, struct strmap *live) {
+	const struct ast_node_list *list = &node->value.children;
+	if (list->size != 2 || (node->flags & AST_FLAG_DEAD_STORE))
+		return;
+
+	set_remove(live, list->l[0].value.token.str);
+	add_uses(live, &list->l[1]);
+}
+
+static size_t live_stmt_list(
+	struct ast_node *node,
+	struct strmap *live,
+	const struct loop_live *loop,
+	bool mark,
+	bool checked
+);
+
+// whether evaluating node can trap when overflow is checked (+, - including negation, *)
+static bool has_checked_op(const struct ast_node *node) {
+	if (node->type == AST_LEAF) {
+		enum lex_token_type type = node->value.token.type;
+		return type == LEX_PLUS || type == LEX_MINUS || type == LEX_STAR;
+	}
+
+	for (size_t i = 0; i < node->value.children.size; i++) {
+		if (has_checked_op(&node->value.children.l[i]))
+			return true;
+	}
+	return false;
+}
+
+// checked: overflow traps, so a store is only dead if its value cannot trap either
+static size_t live_assign_stmt(struct ast_node *node, struct strmap *live, bool mark, bool checked) {
+	const struct ast_node_list *list = &node->value.children;
+	if (mark && !(node->flags & AST_FLAG_DEAD_STORE) &&
+		!set_has(live, list->l[0].value.token.str) && !ast_contains(&list->l[1], AST_FUNC_CALL) &&
+		!(checked && has_checked_op(&list->l[1]))) {
+		node->flags |= AST_FLAG_DEAD_STORE;
+		return 1;
+	}
+
+	live_assign(node, live);
+	return 0;
+}
+
+static size_t live_conditional(
+	struct ast_node *node,
+	struct strmap *live,
+	const struct loop_live *loop,
+	bool mark,
+	bool checked
+) {
+	struct ast_node_list *list = &node->value.children;
+	size_t marked = 0;
+
+	struct strmap live_then = strmap_copy(live);
+	marked += live_stmt_list(&list->l[1], &live_then, loop, mark, checked);
+
+	// without an else, what is live after the if is live before it too
+	if (list->size == 3)
+		marked += live_stmt_list(&list->l[2], live, loop, mark, checked);
+	set_union(live, &live_then);
+	strmap_free(&live_then);
+
+	add_uses(live, &list->l[0]);
+	return marked;
+}
+
+static size_t live_for_loop(struct ast_node *node, struct strmap *live, bool mark, bool checked) {
+	struct ast_node_list *list = &node->value.children;
+	struct ast_node *init = &list->l[0], *cond = &list->l[1], *step = &list->l[2];
+	struct ast_node *body = &list->l[3];
+
+	struct strmap after = strmap_copy(live);
+	struct strmap body_live = strmap_new();
+	struct strmap cond_live = strmap_new(), step_live = strmap_new();
+
+	// iterate until the variables live at the start of the body stop growing
+	// marking is only done on the last round, when the sets are final
+	size_t marked = 0;
+	bool done = false;
+	while (true) {
+		// an empty condition never exits the loop
+		set_assign(&cond_live, &body_live);
+		if (cond->value.children.size != 0) {
+			set_union(&cond_live, &after);
+			add_uses(&cond_live, cond);
+		}
+
+		set_assign(&step_live, &cond_live);
+		live_assign(step, &step_live);
+
+		struct strmap new_body_live = strmap_copy(&step_live);
+		struct loop_live loop = {.break_live = &after, .continue_live = &step_live};
+		marked += live_stmt_list(body, &new_body_live, &loop, done && mark, checked);
+
+		bool changed = !set_subset(&new_body_live, &body_live);
+		strmap_free(&body_live);
+		body_live = new_body_live;
+
+		if (done)
+			break;
+		done = !changed;
+	}
+
+	set_assign(live, &cond_live);
+	live_assign(init, live);
+
+	strmap_free(&after);
+	strmap_free(&body_live);
+	strmap_free(&cond_live);
+	strmap_free(&step_live);
+	return marked;
+}
+
+static size_t live_stmt_list(
+	struct ast_node *node,
+	struct strmap *live,
+	const struct loop_live *loop,
+	bool mark,
+	bool checked
+) {
+	struct ast_node_list *list = &node->value.children;
+	size_t marked = 0;
+
+	for (size_t i = list->size; i-- > 0;) {
+		struct ast_node *child = &list->l[i].value.children.l[0];
+		switch (child->type) {
+			case AST_ASSIGN:
+				marked += live_assign_stmt(child, live, mark, checked);
+				break;
+			case AST_FUNC_CALL:
+				add_uses(live, child);
+				break;
+			case AST_RETURN:
+				// nothing after a return is reached
+				strmap_free(live);
+				*live = strmap_new();
+				add_uses(live, child);
+				break;
+			case AST_CONDITIONAL:
+				marked += live_conditional(child, live, loop, mark, checked);
+				break;
+			case AST_FOR:
+				marked += live_for_loop(child, live, mark, checked);
+				break;
+			case AST_CONTINUE:
+			case AST_BREAK:
+				if (loop == NULL) {
+					fprintf(stderr, "ERROR! continue/break outside loop\n");
+					exit(1);
+				}
+				set_assign(live, child->type == AST_BREAK ? loop->break_live : loop->continue_live);
+				break;
+			default:
+				fprintf(stderr, "ERROR! (22)\n");
+				exit(1);
+		}
+	}
+
+	return marked;
+}
+
+size_t liveness_mark_dead_stores(struct ast_node *root, bool checked) {
+	struct ast_node *stmt_list = &root->value.children.l[0];
+
+	// a dead store no longer reads its operands, which can make the stores
+	// they come from dead as well
+	size_t total = 0, marked;
+	do {
+		struct strmap live = strmap_new();
+		marked = live_stmt_list(stmt_list, &live, NULL, true, checked);
+		strmap_free(&live);
+		total += marked;
+	} while (marked != 0);
+
+	return total;
+}
@@ -0,0 +1,108 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "passes/reachability.h"
+#include "ast.h"
+
+// whether there is a break/continue (type) in node for the loop node is the body of
+// the ones in nested loops are for those loops instead
+static bool has_loop_jump(const struct ast_node *node, enum ast_node_type type) {
+	if (node->type == type)
+		return true;
+	if (node->type == AST_LEAF || node->type == AST_FOR)
+		return false;
+
+	for (size_t i = 0; i < node->value.children.size; i++) {
+		if (has_loop_jump(&node->value.children.l[i], type))
+			return true;
+	}
+	return false;
+}
+
+static bool reach_stmt_list(struct ast_node *node, size_t *removed);
+
+static bool reach_conditional(struct ast_node *node, size_t *removed) {
+	struct ast_node_list *list = &node->value.children;
+
+	bool then_terminates = reach_stmt_list(&list->l[1], removed);
+	bool else_terminates = list->size == 3 && reach_stmt_list(&list->l[2], removed);
+
+	// constant conditions are left by passes/fold.h
+	int32_t condition;
+	if (ast_get_constant(&list->l[0], &condition))
+		return condition != 0 ? then_terminates : else_terminates;
+	return then_terminates && else_terminates;
+}
+
+static bool reach_for_loop(struct ast_node *node, size_t *removed) {
+	struct ast_node_list *list = &node->value.children;
+	struct ast_node *body = &list->l[3];
+
+	if (reach_stmt_list(body, removed) && !has_loop_jump(body, AST_CONTINUE))
+		node->flags |= AST_FLAG_LOOP_ONCE;
+
+	// an empty condition is always true, the loop is only left by a break
+	// (or a return, which terminates as well)
+	// a body that always terminates is left the same way if it is entered
+	// at all, passes/fold.h flags loops whose condition is true on entry
+	bool no_exit = list->l[1].value.children.size == 0 ||
+		((node->flags & AST_FLAG_LOOP_ONCE) && (node->flags & AST_FLAG_LOOP_ENTERS));
+	return no_exit && !has_loop_jump(body, AST_BREAK);
+}
+
+// returns whether control never reaches the statement after node
+static bool reach_stmt(struct ast_node *node, size_t *removed) {
+	struct ast_node *child = &node->value.children.l[0];
+	bool terminates = false;
+
+	switch (child->type) {
+		case AST_ASSIGN:
+		case AST_FUNC_CALL:
+			break;
+		case AST_RETURN:
+		case AST_CONTINUE:
+		case AST_BREAK:
+			terminates = true;
+			break;
+		case AST_CONDITIONAL:
+			terminates = reach_conditional(child, removed);
+			break;
+		case AST_FOR:
+			terminates = reach_for_loop(child, removed);
+			break;
+		default:
+			fprintf(stderr, "ERROR! (25)\n");
+			exit(1);
+	}
+
+	if (terminates)
+		child->flags |= AST_FLAG_TERMINATES;
+	return terminates;
+}
+
+static bool reach_stmt_list(struct ast_node *node, size_t *removed) {
+	struct ast_node_list *list = &node->value.children;
+
+	for (size_t i = 0; i < list->size; i++) {
+		if (!reach_stmt(&list->l[i], removed))
+			continue;
+
+		// everything after a terminating statement is dead
+		while (list->size > i + 1) {
+			ast_remove_node(node, list->size - 1);
+			(*removed)++;
+		}
+		node->flags |= AST_FLAG_TERMINATES;
+		return true;
+	}
+
+	return false;
+}
+
+size_t reachability_remove_dead(struct ast_node *root) {
+	size_t removed = 0;
+	reach_stmt_list(&root->value.children.l[0], &removed);
+	return removed;
+}
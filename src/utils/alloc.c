@@ -0,0 +1,475 @@
+#include <inttypes.h>
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/alloc.h"
+
+#define ALLOC_ARENA_CHUNK_SIZE (64 * 1024)
+#define ALLOC_POOL_MIN_SIZE 16
+#define ALLOC_POOL_CLASSES 7 // 16, 32, ..., 1024
+
+// every allocation is prefixed with its size so that stats can be kept
+// and so that backends get the size back on realloc/free
+// (union so that the pointer returned after the header stays aligned)
+union alloc_header {
+	size_t size;
+	max_align_t align;
+};
+
+// the context of a thread that did not set one, see alloc_ctx_set
+static _Thread_local struct alloc_ctx default_ctx = {
+	.allocators = { &alloc_system, &alloc_system, &alloc_system, &alloc_system, &alloc_system },
+	.fail_subsystem = ALLOC_SUBSYSTEM_COUNT
+};
+// NULL for default_ctx (whose address is not a constant)
+static _Thread_local struct alloc_ctx *current_ctx = NULL;
+
+static struct alloc_ctx *get_ctx(void) {
+	return current_ctx != NULL ? current_ctx : &default_ctx;
+}
+
+static size_t align_size(size_t size) {
+	size_t align = sizeof(max_align_t);
+	return (size + align - 1) / align * align;
+}
+
+static void *system_alloc(void *state, size_t size) {
+	(void) state;
+	return malloc(size);
+}
+static void *system_realloc(void *state, void *ptr, size_t old_size, size_t new_size) {
+	(void) state, (void) old_size;
+	return realloc(ptr, new_size);
+}
+static void system_free(void *state, void *ptr, size_t size) {
+	(void) state, (void) size;
+	free(ptr);
+}
+
+const struct allocator alloc_system = {
+	.name = "system",
+	.state = NULL,
+	.alloc = system_alloc,
+	.realloc = system_realloc,
+	.free = system_free
+};
+
+void alloc_ctx_init(struct alloc_ctx *ctx) {
+	for (int i = 0; i < ALLOC_SUBSYSTEM_COUNT; i++)
+		ctx->allocators[i] = &alloc_system;
+	memset(ctx->stats, 0, sizeof(ctx->stats));
+	ctx->watched_peak = 0;
+	ctx->fail_jump = NULL;
+	ctx->fail_subsystem = ALLOC_SUBSYSTEM_COUNT;
+	ctx->fail_size = 0;
+}
+
+struct alloc_ctx *alloc_ctx_set(struct alloc_ctx *ctx) {
+	struct alloc_ctx *prev = get_ctx();
+	current_ctx = ctx;
+	return prev;
+}
+
+void alloc_set(enum alloc_subsystem subsystem, const struct allocator *allocator) {
+	get_ctx()->allocators[subsystem] = allocator == NULL ? &alloc_system : allocator;
+}
+void alloc_set_all(const struct allocator *allocator) {
+	for (int i = 0; i < ALLOC_SUBSYSTEM_COUNT; i++)
+		alloc_set(i, allocator);
+}
+
+jmp_buf *alloc_set_fail_jump(jmp_buf *jump) {
+	jmp_buf *prev = get_ctx()->fail_jump;
+	get_ctx()->fail_jump = jump;
+	return prev;
+}
+
+void alloc_print_failure(FILE *out) {
+	const struct alloc_ctx *ctx = get_ctx();
+	if (ctx->fail_subsystem == ALLOC_SUBSYSTEM_COUNT)
+		return;
+	fprintf(
+		out, "Error: out of memory (%zu bytes for %s from the %s allocator)\n",
+		ctx->fail_size, alloc_subsystem_to_str(ctx->fail_subsystem),
+		ctx->allocators[ctx->fail_subsystem]->name
+	);
+}
+
+_Noreturn void alloc_fail_again(void) {
+	const struct alloc_ctx *ctx = get_ctx();
+	if (ctx->fail_jump != NULL)
+		longjmp(*ctx->fail_jump, 1);
+
+	alloc_print_failure(stderr);
+	exit(1);
+}
+
+static _Noreturn void fail(enum alloc_subsystem subsystem, size_t size) {
+	struct alloc_ctx *ctx = get_ctx();
+	ctx->fail_subsystem = subsystem;
+	ctx->fail_size = size;
+	alloc_fail_again();
+}
+
+static void stats_add_live(struct alloc_ctx *ctx, struct alloc_stats *cur, size_t size) {
+	cur->live_bytes += size;
+	if (cur->live_bytes > cur->peak_bytes)
+		cur->peak_bytes = cur->live_bytes;
+	if (cur == &ctx->stats[ALLOC_SUBSYSTEM_COUNT] && cur->live_bytes > ctx->watched_peak)
+		ctx->watched_peak = cur->live_bytes;
+}
+
+static void stats_alloc(struct alloc_ctx *ctx, enum alloc_subsystem subsystem, size_t size) {
+	struct alloc_stats *list[] = { &ctx->stats[subsystem], &ctx->stats[ALLOC_SUBSYSTEM_COUNT] };
+	for (int i = 0; i < 2; i++) {
+		list[i]->allocs++;
+		list[i]->total_bytes += size;
+		stats_add_live(ctx, list[i], size);
+	}
+}
+static void stats_realloc(
+	struct alloc_ctx *ctx,
+	enum alloc_subsystem subsystem,
+	size_t old_size,
+	size_t size
+) {
+	struct alloc_stats *list[] = { &ctx->stats[subsystem], &ctx->stats[ALLOC_SUBSYSTEM_COUNT] };
+	for (int i = 0; i < 2; i++) {
+		list[i]->reallocs++;
+		list[i]->total_bytes += size;
+		list[i]->live_bytes -= old_size;
+		stats_add_live(ctx, list[i], size);
+	}
+}
+static void stats_free(struct alloc_ctx *ctx, enum alloc_subsystem subsystem, size_t size) {
+	struct alloc_stats *list[] = { &ctx->stats[subsystem], &ctx->stats[ALLOC_SUBSYSTEM_COUNT] };
+	for (int i = 0; i < 2; i++) {
+		list[i]->frees++;
+		list[i]->live_bytes -= size;
+	}
+}
+
+void *alloc_malloc(enum alloc_subsystem subsystem, size_t size) {
+	struct alloc_ctx *ctx = get_ctx();
+	const struct allocator *allocator = ctx->allocators[subsystem];
+
+	union alloc_header *header = allocator->alloc(
+		allocator->state, size + sizeof(union alloc_header)
+	);
+	if (header == NULL)
+		fail(subsystem, size);
+	header->size = size;
+
+	stats_alloc(ctx, subsystem, size);
+
+	return header + 1;
+}
+
+void *alloc_calloc(enum alloc_subsystem subsystem, size_t count, size_t size) {
+	if (size != 0 && count > SIZE_MAX / size)
+		fail(subsystem, SIZE_MAX);
+
+	void *ptr = alloc_malloc(subsystem, count * size);
+	memset(ptr, 0, count * size);
+	return ptr;
+}
+
+// total_bytes counts the new size of a realloc as allocated
+void *alloc_realloc(enum alloc_subsystem subsystem, void *ptr, size_t size) {
+	if (ptr == NULL)
+		return alloc_malloc(subsystem, size);
+
+	struct alloc_ctx *ctx = get_ctx();
+	const struct allocator *allocator = ctx->allocators[subsystem];
+
+	union alloc_header *header = (union alloc_header *) ptr - 1;
+	size_t old_size = header->size;
+
+	header = allocator->realloc(
+		allocator->state, header,
+		old_size + sizeof(union alloc_header),
+		size + sizeof(union alloc_header)
+	);
+	if (header == NULL)
+		fail(subsystem, size);
+	header->size = size;
+
+	stats_realloc(ctx, subsystem, old_size, size);
+
+	return header + 1;
+}
+
+void alloc_free(enum alloc_subsystem subsystem, void *ptr) {
+	if (ptr == NULL)
+		return;
+
+	struct alloc_ctx *ctx = get_ctx();
+	const struct allocator *allocator = ctx->allocators[subsystem];
+	union alloc_header *header = (union alloc_header *) ptr - 1;
+
+	stats_free(ctx, subsystem, header->size);
+	allocator->free(allocator->state, header, header->size + sizeof(union alloc_header));
+}
+
+const char *alloc_subsystem_to_str(enum alloc_subsystem subsystem) {
+	switch (subsystem) {
+		case ALLOC_LEX:
+			return "lex";
+		case ALLOC_AST:
+			return "ast";
+		case ALLOC_STRMAP:
+			return "strmap";
+		case ALLOC_LINKEDLIST:
+			return "linkedlist";
+		case ALLOC_CODEGEN:
+			return "codegen";
+		case ALLOC_SUBSYSTEM_COUNT:
+			break;
+	}
+	return "";
+}
+
+const struct alloc_stats *alloc_get_stats(enum alloc_subsystem subsystem) {
+	return &get_ctx()->stats[subsystem];
+}
+
+const struct alloc_stats *alloc_get_total_stats(void) {
+	return &get_ctx()->stats[ALLOC_SUBSYSTEM_COUNT];
+}
+
+void alloc_reset_stats(void) {
+	struct alloc_ctx *ctx = get_ctx();
+	memset(ctx->stats, 0, sizeof(ctx->stats));
+	ctx->watched_peak = 0;
+}
+
+void alloc_watch_peak(void) {
+	struct alloc_ctx *ctx = get_ctx();
+	ctx->watched_peak = ctx->stats[ALLOC_SUBSYSTEM_COUNT].live_bytes;
+}
+
+uint64_t alloc_watched_peak(void) {
+	return get_ctx()->watched_peak;
+}
+
+void alloc_print_stats(FILE *out) {
+	const struct alloc_ctx *ctx = get_ctx();
+	fprintf(out, "\n========== ALLOC STATS ==========\n\n");
+	fprintf(
+		out, "%-12s %-8s %10s %10s %10s %12s %12s %12s\n",
+		"subsystem", "backend", "allocs", "reallocs", "frees",
+		"total bytes", "live bytes", "peak bytes"
+	);
+	for (int i = 0; i < ALLOC_SUBSYSTEM_COUNT; i++) {
+		const struct alloc_stats *cur = &ctx->stats[i];
+		fprintf(
+			out, "%-12s %-8s %10" PRIu64 " %10" PRIu64 " %10" PRIu64
+			" %12" PRIu64 " %12" PRIu64 " %12" PRIu64 "\n",
+			alloc_subsystem_to_str(i), ctx->allocators[i]->name,
+			cur->allocs, cur->reallocs, cur->frees,
+			cur->total_bytes, cur->live_bytes, cur->peak_bytes
+		);
+	}
+	fprintf(out, "\n=================================\n\n");
+}
+
+
+
+struct alloc_arena_chunk {
+	struct alloc_arena_chunk *next;
+	size_t size, used;
+	max_align_t data[];
+};
+struct alloc_arena {
+	struct alloc_arena_chunk *chunks;
+	size_t limit, reserved;
+};
+
+struct alloc_arena *alloc_arena_new(size_t limit) {
+	struct alloc_arena *arena = malloc(sizeof(struct alloc_arena));
+	if (arena == NULL)
+		return NULL;
+
+	arena->chunks = NULL;
+	arena->limit = limit;
+	arena->reserved = 0;
+	return arena;
+}
+
+static void *arena_alloc(void *state, size_t size) {
+	struct alloc_arena *arena = state;
+	size = align_size(size);
+
+	// only the newest chunk is allocated from, the rest of an old chunk is wasted
+	struct alloc_arena_chunk *chunk = arena->chunks;
+	if (chunk == NULL || chunk->size - chunk->used < size) {
+		size_t chunk_size = size > ALLOC_ARENA_CHUNK_SIZE ? size : ALLOC_ARENA_CHUNK_SIZE;
+		if (arena->limit != 0 && arena->reserved + chunk_size > arena->limit) {
+			chunk_size = size;
+			if (arena->reserved + chunk_size > arena->limit)
+				return NULL;
+		}
+
+		chunk = malloc(sizeof(struct alloc_arena_chunk) + chunk_size);
+		if (chunk == NULL)
+			return NULL;
+
+		chunk->next = arena->chunks;
+		chunk->size = chunk_size;
+		chunk->used = 0;
+		arena->chunks = chunk;
+		arena->reserved += chunk_size;
+	}
+
+	void *ptr = (unsigned char *) chunk->data + chunk->used;
+	chunk->used += size;
+	return ptr;
+}
+
+static void *arena_realloc(void *state, void *ptr, size_t old_size, size_t new_size) {
+	struct alloc_arena *arena = state;
+	struct alloc_arena_chunk *chunk = arena->chunks;
+
+	// most recent allocation can be resized in place
+	unsigned char *end = (unsigned char *) ptr + align_size(old_size);
+	if (chunk != NULL && end == (unsigned char *) chunk->data + chunk->used) {
+		size_t start = chunk->used - align_size(old_size);
+		if (chunk->size - start >= align_size(new_size)) {
+			chunk->used = start + align_size(new_size);
+			return ptr;
+		}
+	}
+
+	void *new_ptr = arena_alloc(state, new_size);
+	if (new_ptr == NULL)
+		return NULL;
+	memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+	return new_ptr;
+}
+
+static void arena_free(void *state, void *ptr, size_t size) {
+	// released in bulk by alloc_arena_free
+	(void) state, (void) ptr, (void) size;
+}
+
+struct allocator alloc_arena_allocator(struct alloc_arena *arena) {
+	return (struct allocator) {
+		.name = "arena",
+		.state = arena,
+		.alloc = arena_alloc,
+		.realloc = arena_realloc,
+		.free = arena_free
+	};
+}
+
+size_t alloc_arena_reserved(const struct alloc_arena *arena) {
+	return arena->reserved;
+}
+
+void alloc_arena_free(struct alloc_arena *arena) {
+	struct alloc_arena_chunk *cur = arena->chunks, *next = NULL;
+	while (cur != NULL) {
+		next = cur->next;
+		free(cur);
+		cur = next;
+	}
+	free(arena);
+}
+
+
+
+struct alloc_pool_block {
+	struct alloc_pool_block *next;
+};
+struct alloc_pool {
+	struct alloc_arena *arena;
+	struct alloc_pool_block *free_lists[ALLOC_POOL_CLASSES];
+};
+
+// -1 if too big for any size class (allocated straight from the arena)
+static int pool_class(size_t size) {
+	size_t class_size = ALLOC_POOL_MIN_SIZE;
+	for (int i = 0; i < ALLOC_POOL_CLASSES; i++) {
+		if (size <= class_size)
+			return i;
+		class_size *= 2;
+	}
+	return -1;
+}
+
+struct alloc_pool *alloc_pool_new(size_t limit) {
+	struct alloc_pool *pool = malloc(sizeof(struct alloc_pool));
+	if (pool == NULL)
+		return NULL;
+
+	pool->arena = alloc_arena_new(limit);
+	if (pool->arena == NULL) {
+		free(pool);
+		return NULL;
+	}
+	for (int i = 0; i < ALLOC_POOL_CLASSES; i++)
+		pool->free_lists[i] = NULL;
+	return pool;
+}
+
+static void *pool_alloc(void *state, size_t size) {
+	struct alloc_pool *pool = state;
+	int class = pool_class(size);
+	if (class == -1)
+		return arena_alloc(pool->arena, size);
+
+	struct alloc_pool_block *block = pool->free_lists[class];
+	if (block != NULL) {
+		pool->free_lists[class] = block->next;
+		return block;
+	}
+
+	return arena_alloc(pool->arena, (size_t) ALLOC_POOL_MIN_SIZE << class);
+}
+
+static void pool_free(void *state, void *ptr, size_t size) {
+	struct alloc_pool *pool = state;
+	int class = pool_class(size);
+	if (class == -1)
+		return;
+
+	struct alloc_pool_block *block = ptr;
+	block->next = pool->free_lists[class];
+	pool->free_lists[class] = block;
+}
+
+static void *pool_realloc(void *state, void *ptr, size_t old_size, size_t new_size) {
+	int class = pool_class(old_size);
+	if (class != -1 && class == pool_class(new_size))
+		return ptr;
+
+	void *new_ptr = pool_alloc(state, new_size);
+	if (new_ptr == NULL)
+		return NULL;
+	memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+	pool_free(state, ptr, old_size);
+	return new_ptr;
+}
+
+struct allocator alloc_pool_allocator(struct alloc_pool *pool) {
+	return (struct allocator) {
+		.name = "pool",
+		.state = pool,
+		.alloc = pool_alloc,
+		.realloc = pool_realloc,
+		.free = pool_free
+	};
+}
+
+size_t alloc_pool_reserved(const struct alloc_pool *pool) {
+	return alloc_arena_reserved(pool->arena);
+}
+
+void alloc_pool_free(struct alloc_pool *pool) {
+	alloc_arena_free(pool->arena);
+	free(pool);
+}
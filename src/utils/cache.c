@@ -0,0 +1,344 @@
+#include <llvm/Config/llvm-config.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils/cache.h"
+#include "utils/sha256.h"
+
+// changes whenever the key or the entry format changes
+#define CACHE_FORMAT "jlang cache 2"
+
+// returns <dir>/<name>, NULL on malloc failure
+static char *join_path(const char *dir, const char *name) {
+	char *path = malloc(strlen(dir) + 1 + strlen(name) + 1);
+	if (path == NULL)
+		return NULL;
+
+	strcpy(path, dir);
+	strcat(path, "/");
+	strcat(path, name);
+	return path;
+}
+
+// mkdir -p
+static bool make_dirs(char *path) {
+	if (path[0] == 0)
+		return false;
+
+	for (char *c = path + 1; ; c++) {
+		if (*c != '/' && *c != 0)
+			continue;
+
+		char end = *c;
+		*c = 0;
+		bool made = mkdir(path, 0777) == 0 || errno == EEXIST;
+		*c = end;
+		if (!made || end == 0)
+			return made;
+	}
+}
+
+static void to_hex(const uint8_t digest[SHA256_DIGEST_SIZE], char hex[CACHE_KEY_SIZE]) {
+	for (size_t i = 0; i < SHA256_DIGEST_SIZE; i++)
+		snprintf(hex + i * 2, 3, "%02x", digest[i]);
+}
+
+static bool hash_file(const char *path, char hex[CACHE_KEY_SIZE]) {
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+		return false;
+
+	struct sha256 hash;
+	sha256_init(&hash);
+	char buffer[64 * 1024];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		sha256_update(&hash, buffer, read);
+	bool ok = !ferror(file);
+	fclose(file);
+
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	sha256_final(&hash, digest);
+	to_hex(digest, hex);
+	return ok;
+}
+
+// a hash of the executable's contents, so that the same build of the compiler makes the
+// same keys wherever it is installed (e.g. CI shards sharing or restoring a cache)
+// hashing it on every compile would be slow, the result is kept in dir, in a file named
+// after this host and the executable's device, inode, size and modification time
+// (which are only meaningful on this host, a shared directory can have several)
+static bool compiler_id(const char *dir, char id[CACHE_KEY_SIZE]) {
+	struct stat self;
+	char host[256];
+	if (stat("/proc/self/exe", &self) != 0 || gethostname(host, sizeof(host)) != 0)
+		return false;
+	host[sizeof(host) - 1] = 0;
+
+	char identity[512];
+	snprintf(
+		identity, sizeof(identity), "%s %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 ".%09ld",
+		host, (uint64_t) self.st_dev, (uint64_t) self.st_ino, (uint64_t) self.st_size,
+		(uint64_t) self.st_mtim.tv_sec, self.st_mtim.tv_nsec
+	);
+	struct sha256 hash;
+	sha256_init(&hash);
+	sha256_update(&hash, identity, strlen(identity));
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	sha256_final(&hash, digest);
+
+	// not CACHE_KEY_SIZE - 1 long, so never evicted
+	char name[sizeof("compiler-") + CACHE_KEY_SIZE];
+	strcpy(name, "compiler-");
+	to_hex(digest, name + strlen("compiler-"));
+	char *memo = join_path(dir, name);
+	if (memo == NULL)
+		return false;
+
+	FILE *file = fopen(memo, "r");
+	if (file != NULL) {
+		bool ok = fread(id, 1, CACHE_KEY_SIZE - 1, file) == CACHE_KEY_SIZE - 1;
+		fclose(file);
+		id[CACHE_KEY_SIZE - 1] = 0;
+		if (ok) {
+			free(memo);
+			return true;
+		}
+	}
+
+	if (!hash_file("/proc/self/exe", id)) {
+		free(memo);
+		return false;
+	}
+
+	// written like an entry, a concurrent compile reads all of it or nothing
+	char *temp = join_path(dir, "tmp-XXXXXX");
+	int fd = temp != NULL ? mkstemp(temp) : -1;
+	if (fd != -1) {
+		bool written = write(fd, id, CACHE_KEY_SIZE - 1) == CACHE_KEY_SIZE - 1;
+		written = close(fd) == 0 && written;
+		if (!written || rename(temp, memo) != 0)
+			unlink(temp);
+	}
+	free(temp);
+	free(memo);
+	return true;
+}
+
+bool cache_open(struct cache *cache, const char *dir, uint64_t max_bytes) {
+	cache->max_bytes = max_bytes;
+
+	const char *env;
+	if (dir != NULL)
+		cache->dir = strdup(dir);
+	else if ((env = getenv("JLANG_CACHE_DIR")) != NULL && env[0] != 0)
+		cache->dir = strdup(env);
+	else if ((env = getenv("XDG_CACHE_HOME")) != NULL && env[0] != 0)
+		cache->dir = join_path(env, "jlang");
+	else if ((env = getenv("HOME")) != NULL && env[0] != 0)
+		cache->dir = join_path(env, ".cache/jlang");
+	else {
+		fprintf(stderr, "Warning: cache: no directory, set JLANG_CACHE_DIR\n");
+		cache->dir = NULL;
+		return false;
+	}
+
+	if (cache->dir == NULL) {
+		fprintf(stderr, "Error: malloc failure\n");
+		return false;
+	}
+	if (!make_dirs(cache->dir)) {
+		fprintf(stderr, "Warning: cache: cannot create %s: %s\n", cache->dir, strerror(errno));
+		cache_close(cache);
+		return false;
+	}
+	if (!compiler_id(cache->dir, cache->compiler)) {
+		fprintf(stderr, "Warning: cache: cannot read the compiler executable\n");
+		cache_close(cache);
+		return false;
+	}
+	return true;
+}
+
+void cache_close(struct cache *cache) {
+	free(cache->dir);
+	cache->dir = NULL;
+}
+
+void cache_make_key(
+	const struct cache *cache,
+	char key[CACHE_KEY_SIZE],
+	const char *config,
+	const char *const *lines,
+	const size_t *line_lens,
+	size_t num_lines
+) {
+	char compiler[256];
+	snprintf(
+		compiler, sizeof(compiler), "%s\nLLVM %s\n%s\n",
+		CACHE_FORMAT, LLVM_VERSION_STRING, cache->compiler
+	);
+
+	struct sha256 hash;
+	sha256_init(&hash);
+	// the terminators keep the parts apart
+	sha256_update(&hash, compiler, strlen(compiler) + 1);
+	sha256_update(&hash, config, strlen(config) + 1);
+	for (size_t i = 0; i < num_lines; i++)
+		sha256_update(&hash, lines[i], line_lens[i]);
+
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	sha256_final(&hash, digest);
+	to_hex(digest, key);
+}
+
+static bool copy_file(FILE *from, FILE *to) {
+	char buffer[64 * 1024];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), from)) > 0) {
+		if (fwrite(buffer, 1, read, to) != read)
+			return false;
+	}
+	return !ferror(from);
+}
+
+bool cache_fetch(const struct cache *cache, const char *key, const char *path) {
+	char *entry = join_path(cache->dir, key);
+	if (entry == NULL)
+		return false;
+
+	FILE *from = fopen(entry, "rb");
+	if (from == NULL) {
+		free(entry);
+		return false;
+	}
+
+	bool ok = false;
+	FILE *to = fopen(path, "wb");
+	if (to != NULL) {
+		ok = copy_file(from, to);
+		ok = fclose(to) == 0 && ok;
+	}
+	fclose(from);
+
+	if (ok) {
+		// most recently used now
+		utimensat(AT_FDCWD, entry, NULL, 0);
+	}
+	else {
+		fprintf(stderr, "Warning: cache: cannot copy %s to %s\n", entry, path);
+		unlink(path);
+	}
+
+	free(entry);
+	return ok;
+}
+
+struct cache_entry {
+	char name[CACHE_KEY_SIZE];
+	uint64_t size;
+	struct timespec used;
+};
+
+static int compare_used(const void *a, const void *b) {
+	const struct timespec *x = &((const struct cache_entry *) a)->used;
+	const struct timespec *y = &((const struct cache_entry *) b)->used;
+	if (x->tv_sec != y->tv_sec)
+		return x->tv_sec < y->tv_sec ? -1 : 1;
+	if (x->tv_nsec != y->tv_nsec)
+		return x->tv_nsec < y->tv_nsec ? -1 : 1;
+	return 0;
+}
+
+// removes the least recently used entries until the directory fits in max_bytes
+// temporary files of compiles still storing are not counted
+static void evict(const struct cache *cache) {
+	DIR *dir = opendir(cache->dir);
+	if (dir == NULL)
+		return;
+
+	struct cache_entry *entries = NULL;
+	size_t size = 0, capacity = 0;
+	uint64_t total = 0;
+
+	struct dirent *dirent;
+	while ((dirent = readdir(dir)) != NULL) {
+		if (strlen(dirent->d_name) != CACHE_KEY_SIZE - 1)
+			continue;
+
+		struct stat st;
+		if (fstatat(dirfd(dir), dirent->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode))
+			continue;
+
+		if (size == capacity) {
+			capacity = capacity == 0 ? 64 : capacity * 2;
+			struct cache_entry *grown = realloc(entries, capacity * sizeof(struct cache_entry));
+			if (grown == NULL)
+				break;
+			entries = grown;
+		}
+		strcpy(entries[size].name, dirent->d_name);
+		entries[size].size = st.st_size;
+		entries[size].used = st.st_mtim;
+		total += st.st_size;
+		size++;
+	}
+
+	if (total > cache->max_bytes) {
+		qsort(entries, size, sizeof(struct cache_entry), compare_used);
+		for (size_t i = 0; i < size && total > cache->max_bytes; i++) {
+			if (unlinkat(dirfd(dir), entries[i].name, 0) == 0)
+				total -= entries[i].size;
+		}
+	}
+
+	closedir(dir);
+	free(entries);
+}
+
+void cache_store(const struct cache *cache, const char *key, const char *path) {
+	char *entry = join_path(cache->dir, key);
+	char *temp = join_path(cache->dir, "tmp-XXXXXX");
+	if (entry == NULL || temp == NULL) {
+		free(entry);
+		free(temp);
+		return;
+	}
+
+	bool ok = false;
+	int fd = mkstemp(temp);
+	FILE *from = fopen(path, "rb");
+	if (fd != -1 && from != NULL) {
+		FILE *to = fdopen(fd, "wb");
+		if (to != NULL) {
+			fd = -1;
+			ok = copy_file(from, to);
+			ok = fclose(to) == 0 && ok;
+		}
+	}
+	if (from != NULL)
+		fclose(from);
+	if (fd != -1)
+		close(fd);
+
+	// rename is atomic, readers see either no entry or all of it
+	if (ok && rename(temp, entry) == 0)
+		evict(cache);
+	else {
+		fprintf(stderr, "Warning: cache: cannot store %s\n", path);
+		unlink(temp);
+	}
+
+	free(entry);
+	free(temp);
+}
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include "utils/linkedlist.h"
+#include "utils/alloc.h"
 
 struct ll_list_node *ll_new(void) {
 	return NULL;
@@ -7,7 +8,7 @@ struct ll_list_node *ll_new(void) {
 
 // does not copy the data
 void ll_add(struct ll_list_node **ll_head, void *data) {
-	struct ll_list_node *new_node = malloc(sizeof(struct ll_list_node));
+	struct ll_list_node *new_node = alloc_malloc(ALLOC_LINKEDLIST, sizeof(struct ll_list_node));
 	new_node->next = NULL;
 	new_node->data = data;
 	if (*ll_head == NULL) {
@@ -22,8 +23,9 @@ void ll_free(struct ll_list_node **ll_head) {
 	struct ll_list_node *cur = *ll_head, *next = cur;
 	while (next != NULL) {
 		next = cur->next;
-		free(cur);
+		alloc_free(ALLOC_LINKEDLIST, cur);
 		cur = next;
 	}
+	*ll_head = NULL;
 }
 
@@ -0,0 +1,103 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "utils/memreport.h"
+#include "utils/alloc.h"
+
+static struct mem_report_phase phases[MEM_REPORT_MAX_PHASES];
+static size_t num_phases = 0;
+
+// values at mem_report_begin
+static uint64_t begin_allocs, begin_bytes;
+static int64_t begin_rss;
+
+// current resident set size in bytes, 0 if it cannot be read
+static int64_t get_rss(void) {
+	FILE *statm = fopen("/proc/self/statm", "r");
+	if (statm == NULL)
+		return 0;
+
+	long long pages_total = 0, pages_resident = 0;
+	int read = fscanf(statm, "%lld %lld", &pages_total, &pages_resident);
+	fclose(statm);
+	if (read != 2)
+		return 0;
+
+	return (int64_t) pages_resident * sysconf(_SC_PAGESIZE);
+}
+
+// peak resident set size of the whole process in bytes
+static int64_t get_peak_rss(void) {
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+	return (int64_t) usage.ru_maxrss * 1024;
+}
+
+void mem_report_begin(const char *phase) {
+	if (num_phases >= MEM_REPORT_MAX_PHASES)
+		return;
+
+	const struct alloc_stats *total = alloc_get_total_stats();
+	begin_allocs = total->allocs + total->reallocs;
+	begin_bytes = total->total_bytes;
+	alloc_watch_peak();
+	begin_rss = get_rss();
+
+	phases[num_phases].name = phase;
+}
+
+void mem_report_end(void) {
+	if (num_phases >= MEM_REPORT_MAX_PHASES)
+		return;
+
+	const struct alloc_stats *total = alloc_get_total_stats();
+	struct mem_report_phase *cur = &phases[num_phases++];
+	cur->allocs = total->allocs + total->reallocs - begin_allocs;
+	cur->bytes = total->total_bytes - begin_bytes;
+	cur->peak_bytes = alloc_watched_peak();
+	cur->rss_delta = get_rss() - begin_rss;
+}
+
+static void print_text(FILE *out) {
+	fprintf(out, "\n========== MEMORY REPORT ==========\n\n");
+	fprintf(
+		out, "%-16s %10s %16s %16s %14s\n",
+		"phase", "allocs", "bytes allocated", "peak live bytes", "rss delta"
+	);
+	for (size_t i = 0; i < num_phases; i++) {
+		const struct mem_report_phase *cur = &phases[i];
+		fprintf(
+			out, "%-16s %10" PRIu64 " %16" PRIu64 " %16" PRIu64 " %14" PRId64 "\n",
+			cur->name, cur->allocs, cur->bytes, cur->peak_bytes, cur->rss_delta
+		);
+	}
+	fprintf(out, "\npeak rss: %" PRId64 " bytes\n", get_peak_rss());
+	fprintf(out, "\n===================================\n\n");
+}
+
+static void print_json(FILE *out) {
+	fprintf(out, "{\"phases\": [");
+	for (size_t i = 0; i < num_phases; i++) {
+		const struct mem_report_phase *cur = &phases[i];
+		fprintf(
+			out,
+			"%s{\"name\": \"%s\", \"allocs\": %" PRIu64 ", \"bytes\": %" PRIu64
+			", \"peak_bytes\": %" PRIu64 ", \"rss_delta\": %" PRId64 "}",
+			i == 0 ? "" : ", ",
+			cur->name, cur->allocs, cur->bytes, cur->peak_bytes, cur->rss_delta
+		);
+	}
+	fprintf(out, "], \"peak_rss\": %" PRId64 "}\n", get_peak_rss());
+}
+
+void mem_report_print(FILE *out, bool json) {
+	if (json)
+		print_json(out);
+	else
+		print_text(out);
+}
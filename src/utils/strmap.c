@@ -1,3 +1,4 @@
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -5,11 +6,97 @@
 #include <stdbool.h>
 
 #include "utils/strmap.h"
+#include "utils/alloc.h"
 
 #define STRMAP_STARTING_BUCKETS 100
 #define STRMAP_REHASH_FACTOR 0.75
 #define STRMAP_REHASH_MULTIPLY 2
 
+#ifdef STRMAP_STATS
+
+// chain lengths >= STRMAP_STATS_MAX_CHAIN all go in the last histogram bucket
+#define STRMAP_STATS_MAX_CHAIN 8
+
+struct strmap_stats {
+	uint64_t gets, sets, rehashes, copies, copy_bytes;
+	uint64_t chain_hist[STRMAP_STATS_MAX_CHAIN + 1];
+};
+
+// per thread, like the allocation statistics
+static _Thread_local struct strmap_stats stats[STRMAP_SITE_COUNT];
+static _Thread_local enum strmap_stats_site current_site = STRMAP_SITE_OTHER;
+
+static const char *strmap_stats_site_to_str(enum strmap_stats_site site) {
+	switch (site) {
+		case STRMAP_SITE_OTHER:
+			return "other";
+		case STRMAP_SITE_FOR:
+			return "for";
+		case STRMAP_SITE_IF:
+			return "if";
+		case STRMAP_SITE_BREAK_CONT:
+			return "break/continue";
+		case STRMAP_SITE_COUNT:
+			break;
+	}
+	return "";
+}
+
+static void strmap_stats_chain(uint64_t length) {
+	if (length > STRMAP_STATS_MAX_CHAIN)
+		length = STRMAP_STATS_MAX_CHAIN;
+	stats[current_site].chain_hist[length]++;
+}
+
+// returns the previous site so that nested constructs can restore it
+enum strmap_stats_site strmap_stats_enter(enum strmap_stats_site site) {
+	enum strmap_stats_site prev_site = current_site;
+	current_site = site;
+	return prev_site;
+}
+void strmap_stats_leave(enum strmap_stats_site prev_site) {
+	current_site = prev_site;
+}
+
+void strmap_stats_print(FILE *out) {
+	fprintf(out, "\n========== STRMAP STATS ==========\n\n");
+	fprintf(
+		out, "%-16s %10s %10s %10s %10s %12s\n",
+		"site", "gets", "sets", "rehashes", "copies", "copy bytes"
+	);
+	for (int i = 0; i < STRMAP_SITE_COUNT; i++) {
+		const struct strmap_stats *cur = &stats[i];
+		fprintf(
+			out, "%-16s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %12" PRIu64 "\n",
+			strmap_stats_site_to_str(i),
+			cur->gets, cur->sets, cur->rehashes, cur->copies, cur->copy_bytes
+		);
+	}
+
+	fprintf(out, "\nchain length histogram (nodes visited per get/set)\n");
+	fprintf(out, "%-16s", "site");
+	for (int len = 0; len < STRMAP_STATS_MAX_CHAIN; len++)
+		fprintf(out, " %8d", len);
+	fprintf(out, " %7d+\n", STRMAP_STATS_MAX_CHAIN);
+	for (int i = 0; i < STRMAP_SITE_COUNT; i++) {
+		fprintf(out, "%-16s", strmap_stats_site_to_str(i));
+		for (int len = 0; len <= STRMAP_STATS_MAX_CHAIN; len++)
+			fprintf(out, " %8" PRIu64, stats[i].chain_hist[len]);
+		fprintf(out, "\n");
+	}
+	fprintf(out, "\n==================================\n\n");
+}
+
+#define STATS_INC(field) (stats[current_site].field++)
+#define STATS_ADD(field, amount) (stats[current_site].field += (amount))
+#define STATS_CHAIN(length) strmap_stats_chain(length)
+#else
+#define STATS_INC(field) ((void) 0)
+#define STATS_ADD(field, amount) ((void) 0)
+// still uses the variable the length is counted in, so it is not unused-but-set
+#define STATS_CHAIN(length) ((void) (length))
+#endif
+
 // djb2 algorithm: http://www.cse.yorku.ca/~oz/hash.html
 static uint64_t djb2_hash(const unsigned char *str) {
 	uint64_t hash = 5381;
@@ -23,7 +110,7 @@ static uint64_t djb2_hash(const unsigned char *str) {
 
 struct strmap strmap_new() {
 	struct strmap map = {
-		.list = calloc(STRMAP_STARTING_BUCKETS, sizeof(struct strmap_list_node *)),
+		.list = alloc_calloc(ALLOC_STRMAP, STRMAP_STARTING_BUCKETS, sizeof(struct strmap_list_node *)),
 		.bucket_count = STRMAP_STARTING_BUCKETS,
 		.occupied_buckets = 0
 	};
@@ -32,22 +119,26 @@ struct strmap strmap_new() {
 
 struct strmap strmap_copy(const struct strmap *old_map_ptr) {
 	struct strmap new_map = {
-		.list = calloc(old_map_ptr->bucket_count, sizeof(struct strmap_list_node *)),
+		.list = alloc_calloc(ALLOC_STRMAP, old_map_ptr->bucket_count, sizeof(struct strmap_list_node *)),
 		.bucket_count = old_map_ptr->bucket_count,
 		.occupied_buckets = old_map_ptr->occupied_buckets
 	};
 
+	STATS_INC(copies);
+	STATS_ADD(copy_bytes, old_map_ptr->bucket_count * sizeof(struct strmap_list_node *));
+
 	for (uint64_t i = 0; i < old_map_ptr->bucket_count; i++) {
 		const struct strmap_list_node *cur_old = old_map_ptr->list[i];
 		struct strmap_list_node **cur = &new_map.list[i];
 		while (cur_old != NULL) {
-			struct strmap_list_node *new_node = malloc(sizeof(struct strmap_list_node));
+			struct strmap_list_node *new_node = alloc_malloc(ALLOC_STRMAP, sizeof(struct strmap_list_node));
 
 			new_node->next = NULL;
 			new_node->str = cur_old->str;
-			new_node->value = malloc(cur_old->value_size);
+			new_node->value = alloc_malloc(ALLOC_STRMAP, cur_old->value_size);
 			new_node->value_size = cur_old->value_size;
 			memcpy(new_node->value, cur_old->value, cur_old->value_size);
+			STATS_ADD(copy_bytes, sizeof(struct strmap_list_node) + cur_old->value_size);
 
 			*cur = new_node;
 			cur = &(*cur)->next;
@@ -65,10 +156,11 @@ static void strmap_rehash(struct strmap *map_ptr) {
 
 	uint64_t old_bucket_count = map_ptr->bucket_count;
 	map_ptr->bucket_count *= STRMAP_REHASH_MULTIPLY;
+	STATS_INC(rehashes);
 
 	// printf("[STRMAP] rehash %lu to %lu\n", old_bucket_count, bucket_count);
 
-	map_ptr->list = calloc(map_ptr->bucket_count, sizeof(struct strmap_list_node *));
+	map_ptr->list = alloc_calloc(ALLOC_STRMAP, map_ptr->bucket_count, sizeof(struct strmap_list_node *));
 	for (uint64_t i = 0; i < old_bucket_count; i++) {
 		struct strmap_list_node *cur = old_map[i];
 		while (cur != NULL) {
@@ -85,12 +177,12 @@ static void strmap_rehash(struct strmap *map_ptr) {
 			continue;
 		while (cur != NULL) {
 			next = cur->next;
-			free(cur);
+			alloc_free(ALLOC_STRMAP, cur);
 			cur = next;
 		}
 	}
 
-	free(old_map);
+	alloc_free(ALLOC_STRMAP, old_map);
 }
 
 static void strmap_set_internal(struct strmap *map_ptr, const char *str, void *value, size_t value_size, bool copy_value) {
@@ -101,7 +193,7 @@ static void strmap_set_internal(struct strmap *map_ptr, const char *str, void *v
 
 	void *value_alloc;
 	if (copy_value) {
-		value_alloc = malloc(value_size);
+		value_alloc = alloc_malloc(ALLOC_STRMAP, value_size);
 		memcpy(value_alloc, value, value_size);
 	}
 	else 
@@ -109,7 +201,10 @@ static void strmap_set_internal(struct strmap *map_ptr, const char *str, void *v
 
 
 	if (*head == NULL) {
-		struct strmap_list_node *new_node = malloc(sizeof(struct strmap_list_node));
+		if (copy_value)
+			STATS_CHAIN(0);
+
+		struct strmap_list_node *new_node = alloc_malloc(ALLOC_STRMAP, sizeof(struct strmap_list_node));
 		new_node->next = NULL;
 		new_node->str = str;
 		new_node->value = value_alloc;
@@ -123,17 +218,24 @@ static void strmap_set_internal(struct strmap *map_ptr, const char *str, void *v
 		return;
 	}
 
+	uint64_t chain_length = 0;
 	struct strmap_list_node *cur, *next = *head;
 	do {
 		cur = next;
+		chain_length++;
 		if (strcmp(cur->str, str) == 0) {
-			free(cur->value);
+			if (copy_value)
+				STATS_CHAIN(chain_length);
+			alloc_free(ALLOC_STRMAP, cur->value);
 			cur->value = value_alloc;
 			return;
 		}
 	} while ((next = cur->next) != NULL);
 
-	struct strmap_list_node *new_node = malloc(sizeof(struct strmap_list_node));
+	if (copy_value)
+		STATS_CHAIN(chain_length);
+
+	struct strmap_list_node *new_node = alloc_malloc(ALLOC_STRMAP, sizeof(struct strmap_list_node));
 	new_node->next = NULL;
 	new_node->str = str;
 	new_node->value = value_alloc;
@@ -149,12 +251,19 @@ void *strmap_get(const struct strmap *map_ptr, const char *str) {
 	uint64_t hash = djb2_hash((const unsigned char *) str);
 	struct strmap_list_node *cur = map[hash % map_ptr->bucket_count];
 
+	STATS_INC(gets);
+
+	uint64_t chain_length = 0;
 	while (cur != NULL) {
-		if (strcmp(cur->str, str) == 0)
+		chain_length++;
+		if (strcmp(cur->str, str) == 0) {
+			STATS_CHAIN(chain_length);
 			return cur->value;
+		}
 		cur = cur->next;
 	}
 
+	STATS_CHAIN(chain_length);
 	return NULL;
 }
 
@@ -162,11 +271,12 @@ void *strmap_get(const struct strmap *map_ptr, const char *str) {
 // does NOT copy the key (string)
 // the "value" pointer can be freed/exit scope
 void strmap_set(struct strmap *map_ptr, const char *str, void *value, size_t value_size) {
+	STATS_INC(sets);
 	strmap_set_internal(map_ptr, str, value, value_size, true);
 }
 
 // if ret_value = true, function will return pointer to value
-// the returned pointer must be freed at some point
+// the returned pointer must be freed at some point (with alloc_free(ALLOC_STRMAP, ...))
 // if ret_value = false, this will always return NULL
 void *strmap_remove(struct strmap *map_ptr, const char *str, bool ret_value) {
 	struct strmap_list_node **map = map_ptr->list;
@@ -178,8 +288,8 @@ void *strmap_remove(struct strmap *map_ptr, const char *str, bool ret_value) {
 		void *value = ret_value ? (*head)->value : NULL;
 		struct strmap_list_node *next = (*head)->next;
 		if (!ret_value)
-			free((*head)->value);
-		free(*head);
+			alloc_free(ALLOC_STRMAP, (*head)->value);
+		alloc_free(ALLOC_STRMAP, *head);
 		*head = next;
 		return value;
 	}
@@ -192,8 +302,8 @@ void *strmap_remove(struct strmap *map_ptr, const char *str, bool ret_value) {
 			void *value = ret_value ? cur->value : NULL;
 			struct strmap_list_node *next = cur->next;
 			if (!ret_value)
-				free(cur->value);
-			free(cur);
+				alloc_free(ALLOC_STRMAP, cur->value);
+			alloc_free(ALLOC_STRMAP, cur);
 			prev->next = next;
 			return value;
 		}
@@ -214,12 +324,12 @@ void strmap_free(const struct strmap *map_ptr) {
 			continue;
 		while (cur != NULL) {
 			next = cur->next;
-			free(cur->value);
-			free(cur);
+			alloc_free(ALLOC_STRMAP, cur->value);
+			alloc_free(ALLOC_STRMAP, cur);
 			cur = next;
 		}
 	}
 
-	free(map_ptr->list);
+	alloc_free(ALLOC_STRMAP, map_ptr->list);
 }
 
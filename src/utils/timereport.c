@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "utils/timereport.h"
+
+static struct time_report_phase phases[TIME_REPORT_MAX_PHASES];
+static size_t num_phases = 0;
+
+// values at time_report_begin
+static double begin_wall, begin_cpu;
+
+static double get_time(clockid_t clock) {
+	struct timespec ts;
+	if (clock_gettime(clock, &ts) != 0)
+		return 0;
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void time_report_begin(const char *phase) {
+	if (num_phases >= TIME_REPORT_MAX_PHASES)
+		return;
+
+	phases[num_phases].name = phase;
+	begin_cpu = get_time(CLOCK_PROCESS_CPUTIME_ID);
+	begin_wall = get_time(CLOCK_MONOTONIC);
+}
+
+void time_report_end(void) {
+	double end_wall = get_time(CLOCK_MONOTONIC);
+	double end_cpu = get_time(CLOCK_PROCESS_CPUTIME_ID);
+
+	if (num_phases >= TIME_REPORT_MAX_PHASES)
+		return;
+
+	struct time_report_phase *cur = &phases[num_phases++];
+	cur->wall = end_wall - begin_wall;
+	cur->cpu = end_cpu - begin_cpu;
+}
+
+static double percent(double part, double total) {
+	return total == 0 ? 0 : part / total * 100;
+}
+
+// same layout as clang's -ftime-report so the LLVM pass timers printed with it line up
+void time_report_print(FILE *out) {
+	double total_wall = 0, total_cpu = 0;
+	for (size_t i = 0; i < num_phases; i++) {
+		total_wall += phases[i].wall;
+		total_cpu += phases[i].cpu;
+	}
+
+	fprintf(out, "===-------------------------------------------------------------------------===\n");
+	fprintf(out, "                          jlang pipeline timing report\n");
+	fprintf(out, "===-------------------------------------------------------------------------===\n");
+	fprintf(out, "  Total Execution Time: %.4f seconds (%.4f wall clock)\n\n", total_cpu, total_wall);
+	fprintf(out, "   ---User+System---   ---Wall Time---  --- Name ---\n");
+	for (size_t i = 0; i < num_phases; i++) {
+		const struct time_report_phase *cur = &phases[i];
+		fprintf(
+			out, "   %.4f (%5.1f%%)   %.4f (%5.1f%%)  %s\n",
+			cur->cpu, percent(cur->cpu, total_cpu),
+			cur->wall, percent(cur->wall, total_wall),
+			cur->name
+		);
+	}
+	fprintf(
+		out, "   %.4f (100.0%%)   %.4f (100.0%%)  Total\n\n",
+		total_cpu, total_wall
+	);
+}
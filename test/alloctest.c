@@ -0,0 +1,245 @@
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/alloc.h"
+
+// the limits are below one arena chunk, so the arena has to fall back to exact sizes
+#define LIMIT 4096
+#define SMALL 24
+#define LARGE 3000
+
+static bool failed = false;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "ERROR! %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		failed = true; \
+	} \
+} while (0)
+
+// whether the allocation takes the fail jump, ptr is reallocated unless it is NULL
+static bool alloc_fails(void *ptr, size_t size) {
+	jmp_buf jump;
+	jmp_buf *prev = alloc_set_fail_jump(&jump);
+	bool fails = true;
+	if (!setjmp(jump)) {
+		alloc_realloc(ALLOC_AST, ptr, size);
+		fails = false;
+	}
+	alloc_set_fail_jump(prev);
+	return fails;
+}
+
+static bool calloc_fails(size_t count, size_t size) {
+	jmp_buf jump;
+	jmp_buf *prev = alloc_set_fail_jump(&jump);
+	bool fails = true;
+	if (!setjmp(jump)) {
+		alloc_calloc(ALLOC_AST, count, size);
+		fails = false;
+	}
+	alloc_set_fail_jump(prev);
+	return fails;
+}
+
+// max_align_t's alignment can be less than its size (16 and 32 on x86-64)
+static bool aligned(const void *ptr) {
+	struct align_test {
+		char c;
+		max_align_t align;
+	};
+	return (uintptr_t) ptr % offsetof(struct align_test, align) == 0;
+}
+
+// allocations keep their contents and do not overlap, whatever the backend
+static void test_basic(const char *name) {
+	char *ptrs[64];
+	for (int i = 0; i < 64; i++) {
+		ptrs[i] = alloc_malloc(ALLOC_AST, (size_t) i + 1);
+		CHECK(ptrs[i] != NULL && aligned(ptrs[i]));
+		memset(ptrs[i], i, (size_t) i + 1);
+	}
+	for (int i = 0; i < 64; i += 2)
+		ptrs[i] = alloc_realloc(ALLOC_AST, ptrs[i], (size_t) i + 100);
+	for (int i = 0; i < 64; i++) {
+		for (int j = 0; j <= i; j++)
+			CHECK(ptrs[i][j] == i);
+	}
+
+	int *zeros = alloc_calloc(ALLOC_AST, 100, sizeof(int));
+	for (int i = 0; i < 100; i++)
+		CHECK(zeros[i] == 0);
+	alloc_free(ALLOC_AST, zeros);
+
+	for (int i = 0; i < 64; i++)
+		alloc_free(ALLOC_AST, ptrs[i]);
+
+	CHECK(alloc_get_stats(ALLOC_AST)->live_bytes == 0);
+	CHECK(alloc_get_stats(ALLOC_AST)->allocs == 65);
+	printf("%s ok\n", name);
+}
+
+static void test_arena(void) {
+	struct alloc_arena *arena = alloc_arena_new(0);
+	struct allocator allocator = alloc_arena_allocator(arena);
+	alloc_set(ALLOC_AST, &allocator);
+	test_basic("arena");
+
+	// the newest allocation grows in place
+	void *last = alloc_malloc(ALLOC_AST, SMALL);
+	CHECK(alloc_realloc(ALLOC_AST, last, SMALL * 4) == last);
+
+	alloc_set(ALLOC_AST, NULL);
+	alloc_arena_free(arena);
+	alloc_reset_stats();
+
+	arena = alloc_arena_new(LIMIT);
+	allocator = alloc_arena_allocator(arena);
+	alloc_set(ALLOC_AST, &allocator);
+
+	CHECK(!alloc_fails(NULL, LARGE));
+	CHECK(alloc_arena_reserved(arena) <= LIMIT);
+	CHECK(alloc_fails(NULL, LARGE));
+	// a failed allocation is not counted
+	CHECK(alloc_get_stats(ALLOC_AST)->allocs == 1);
+	CHECK(alloc_arena_reserved(arena) <= LIMIT);
+
+	alloc_set(ALLOC_AST, NULL);
+	alloc_arena_free(arena);
+	alloc_reset_stats();
+	printf("arena limit ok\n");
+}
+
+static void test_pool(void) {
+	struct alloc_pool *pool = alloc_pool_new(0);
+	struct allocator allocator = alloc_pool_allocator(pool);
+	alloc_set(ALLOC_AST, &allocator);
+	test_basic("pool");
+
+	// a freed block is reused for the same size class, without reserving more
+	void *first = alloc_malloc(ALLOC_AST, SMALL);
+	size_t reserved = alloc_pool_reserved(pool);
+	alloc_free(ALLOC_AST, first);
+	CHECK(alloc_malloc(ALLOC_AST, SMALL + 1) == first);
+	CHECK(alloc_pool_reserved(pool) == reserved);
+
+	alloc_set(ALLOC_AST, NULL);
+	alloc_pool_free(pool);
+	alloc_reset_stats();
+
+	pool = alloc_pool_new(LIMIT);
+	allocator = alloc_pool_allocator(pool);
+	alloc_set(ALLOC_AST, &allocator);
+
+	void *large = alloc_malloc(ALLOC_AST, LARGE);
+	CHECK(alloc_fails(large, LARGE * 2));
+	// small blocks still fit, and keep being reused once freed
+	for (int i = 0; i < 100; i++) {
+		void *ptr = alloc_malloc(ALLOC_AST, SMALL);
+		alloc_free(ALLOC_AST, ptr);
+	}
+	CHECK(alloc_pool_reserved(pool) <= LIMIT);
+
+	alloc_set(ALLOC_AST, NULL);
+	alloc_pool_free(pool);
+	alloc_reset_stats();
+	printf("pool limit ok\n");
+}
+
+// a watched peak starts over without touching the peaks of the run
+static void test_watch_peak(void) {
+	void *large = alloc_malloc(ALLOC_AST, LARGE);
+	alloc_free(ALLOC_AST, large);
+
+	alloc_watch_peak();
+	void *small = alloc_malloc(ALLOC_LEX, SMALL);
+	CHECK(alloc_watched_peak() == SMALL);
+	CHECK(alloc_get_stats(ALLOC_AST)->peak_bytes == LARGE);
+	CHECK(alloc_get_total_stats()->peak_bytes == LARGE);
+	alloc_free(ALLOC_LEX, small);
+
+	alloc_reset_stats();
+	printf("watch peak ok\n");
+}
+
+// a context has its own allocators and statistics, the thread's default one is untouched
+static void test_ctx(void) {
+	void *outside = alloc_malloc(ALLOC_AST, SMALL);
+
+	struct alloc_arena *arena = alloc_arena_new(LIMIT);
+	struct allocator allocator = alloc_arena_allocator(arena);
+	struct alloc_ctx ctx;
+	alloc_ctx_init(&ctx);
+	struct alloc_ctx *prev = alloc_ctx_set(&ctx);
+	alloc_set_all(&allocator);
+
+	CHECK(alloc_get_total_stats()->allocs == 0);
+	alloc_malloc(ALLOC_LEX, LARGE);
+	CHECK(alloc_fails(NULL, LARGE));
+	CHECK(alloc_get_total_stats()->live_bytes == LARGE);
+
+	alloc_ctx_set(prev);
+	alloc_arena_free(arena);
+	CHECK(alloc_get_total_stats()->live_bytes == SMALL);
+	CHECK(alloc_get_stats(ALLOC_LEX)->allocs == 0);
+	// allocations go to the system allocator again
+	alloc_free(ALLOC_AST, outside);
+	CHECK(alloc_get_total_stats()->live_bytes == 0);
+
+	alloc_reset_stats();
+	printf("ctx ok\n");
+}
+
+// each thread starts with a default context of its own
+#define THREADS 4
+static void *thread_main(void *arg) {
+	struct alloc_pool *pool = alloc_pool_new(LIMIT);
+	struct allocator allocator = alloc_pool_allocator(pool);
+	alloc_set_all(&allocator);
+
+	size_t count = (size_t) (uintptr_t) arg;
+	for (size_t i = 0; i < count; i++)
+		alloc_malloc(ALLOC_AST, SMALL);
+	bool ok = alloc_get_stats(ALLOC_AST)->allocs == count && alloc_fails(NULL, LIMIT);
+
+	alloc_set_all(NULL);
+	alloc_pool_free(pool);
+	return ok ? arg : NULL;
+}
+
+static void test_threads(void) {
+	pthread_t threads[THREADS];
+	for (uintptr_t i = 0; i < THREADS; i++)
+		CHECK(pthread_create(&threads[i], NULL, thread_main, (void *) (i + 1)) == 0);
+	for (uintptr_t i = 0; i < THREADS; i++) {
+		void *result;
+		CHECK(pthread_join(threads[i], &result) == 0 && result == (void *) (i + 1));
+	}
+	CHECK(alloc_get_total_stats()->allocs == 0);
+	printf("threads ok\n");
+}
+
+int main() {
+	test_basic("system");
+	alloc_reset_stats();
+
+	// count * size overflows
+	CHECK(calloc_fails(SIZE_MAX / 2, 4));
+
+	test_watch_peak();
+	test_arena();
+	test_pool();
+	test_ctx();
+	test_threads();
+
+	if (failed)
+		return 1;
+	printf("ok\n");
+	return 0;
+}
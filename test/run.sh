@@ -0,0 +1,42 @@
+#!/bin/sh
+# runs the test programs with jlang --run in every lowering and overflow mode
+# usage: test/run.sh [path to jlang], from the repository root
+
+JLANG=${1:-./jlang}
+failed=0
+
+# flags, program, stdin, expected stdout, expected exit code
+run() {
+	out=$(printf "$3" | $JLANG --run $1 "test/$2.jlang" 2>/dev/null)
+	code=$?
+	if [ "$out" != "$4" ] || [ "$code" != "$5" ]; then
+		echo "FAIL $2 $1: got \"$out\" $code, expected \"$4\" $5"
+		failed=1
+	fi
+}
+
+# program, stdin, expected stdout, expected exit code, in every mode
+check() {
+	for flags in "" "-O2" "--lowering=ssa" "--lowering=memory" "--overflow=trap" "--overflow=undefined -O2" "--fast-compile" "-g"; do
+		run "$flags" "$@"
+	done
+}
+
+check condtest "bc\n" "Y" 1
+check condtest "bd\n" "n" 0
+check fibonacci "10\n" "55" 0
+check fibonacci "20\n" "6765" 0
+check iotest "x" "" 20
+check looptest "" "" 94
+check foldtest "z" "00300" 97
+check termtest "x" "a" 1
+check looptermtest "" "0" 42
+# an overflow traps (SIGILL, 128 + 4) even if the value is never used
+run "" traptest "a" "" 7
+run "--overflow=trap" traptest "a" "" 132
+run "--overflow=trap -O2" traptest "a" "" 132
+
+if [ $failed = 0 ]; then
+	echo "all tests passed"
+fi
+exit $failed